@@ -0,0 +1,15 @@
+#version 430
+layout (location = 0) in vec3 vPos;
+
+out vec3 color;
+
+// Stands in for programs still compiling in the background, so it only needs the shared blocks
+#include "include/frame.glsl"
+#include "include/object.glsl"
+
+void main()
+{
+    vec3 pos = u_position_offset.xyz + vPos * u_position_scale.xyz;
+    color = vec3(1.0, 0.0, 1.0);
+    gl_Position = u_view_proj * u_world * vec4(pos, 1.0);
+}
@@ -0,0 +1,8 @@
+// Shared by every program, written once per frame (see UpdateFrameUniforms)
+layout (std140, binding = 0) uniform Frame
+{
+    mat4 u_view;
+    mat4 u_proj;
+    mat4 u_view_proj;
+    float u_time;
+};
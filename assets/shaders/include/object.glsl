@@ -0,0 +1,10 @@
+// Per draw (see ObjectUniforms). Quantized meshes store positions & tcoords as unorm16 relative to their bounds
+// and normals as 2 snorm16s on an unfolded octahedron.
+layout (std140, binding = 1) uniform Object
+{
+    mat4 u_world;
+    vec4 u_position_offset;         // xyz
+    vec4 u_position_scale;          // xyz
+    vec4 u_tcoord_offset_scale;     // xy offset, zw scale
+    bool u_octahedral_normals;
+};
@@ -0,0 +1,20 @@
+#version 430
+out vec4 fragColor;
+
+// Permutations match mesh.vert's, only TEXTURED changes anything here
+#ifdef TEXTURED
+in vec2 uv;
+
+uniform sampler2D u_sampler0;
+#else
+in vec3 color;
+#endif
+
+void main()
+{
+#ifdef TEXTURED
+    fragColor = texture(u_sampler0, uv);
+#else
+    fragColor = vec4(color, 1.0);
+#endif
+}
@@ -0,0 +1,55 @@
+#version 430
+layout (location = 0) in vec3 vPos;
+layout (location = 1) in vec2 vTcoord;
+layout (location = 2) in vec3 vNorm;
+
+// Permutations (see MESH_SHADER_FEATURES in main.cpp):
+// TEXTURED         outputs uv for mesh.frag to sample, rather than a color
+// TCOORD_COLOR     colors by texture coordinate
+// NORMAL_COLOR     colors by normal (by position without either)
+// INSTANCED        world matrix per instance and quantization as plain uniforms, rather than the Object block
+
+#include "include/frame.glsl"
+#include "include/octahedral.glsl"
+
+#ifdef INSTANCED
+layout (location = 4) in mat4 vWorld;   // Per-instance (see DrawMeshInstanced)
+
+// Quantized meshes store positions & tcoords as unorm16 relative to their bounds
+// and normals as 2 snorm16s on an unfolded octahedron (see SendMeshQuantization)
+uniform vec3 u_position_offset;
+uniform vec3 u_position_scale;
+uniform vec2 u_tcoord_offset;
+uniform vec2 u_tcoord_scale;
+uniform bool u_octahedral_normals;
+
+mat4 World() { return vWorld; }
+vec3 DecodePosition(vec3 p) { return u_position_offset + p * u_position_scale; }
+vec2 DecodeTcoord(vec2 t) { return u_tcoord_offset + t * u_tcoord_scale; }
+#else
+#include "include/object.glsl"
+
+mat4 World() { return u_world; }
+vec3 DecodePosition(vec3 p) { return u_position_offset.xyz + p * u_position_scale.xyz; }
+vec2 DecodeTcoord(vec2 t) { return u_tcoord_offset_scale.xy + t * u_tcoord_offset_scale.zw; }
+#endif
+
+#ifdef TEXTURED
+out vec2 uv;
+#else
+out vec3 color;
+#endif
+
+void main()
+{
+#if defined(TEXTURED)
+    uv = DecodeTcoord(vTcoord);
+#elif defined(TCOORD_COLOR)
+    color = vec3(vTcoord, 0.0);
+#elif defined(NORMAL_COLOR)
+    color = u_octahedral_normals ? OctahedralDecode(vNorm.xy) : vNorm;
+#else
+    color = vPos;
+#endif
+    gl_Position = u_view_proj * World() * vec4(DecodePosition(vPos), 1.0);
+}
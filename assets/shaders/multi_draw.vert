@@ -0,0 +1,30 @@
+#version 430
+layout (location = 0) in vec3 vPos;
+layout (location = 1) in vec2 vTcoord;
+layout (location = 2) in vec3 vNorm;
+layout (location = 3) in uint vDrawId;
+
+out vec3 color;
+
+// One per draw of a MultiDrawBatch, vDrawId is the draw's base instance
+struct Object
+{
+    mat4 world;
+};
+
+layout (std430, binding = 0) readonly buffer Objects
+{
+    Object objects[];
+};
+
+#include "include/frame.glsl"
+
+uniform bool u_octahedral_normals;
+
+#include "include/octahedral.glsl"
+
+void main()
+{
+    color = u_octahedral_normals ? OctahedralDecode(vNorm.xy) : vNorm;
+    gl_Position = u_view_proj * objects[vDrawId].world * vec4(vPos, 1.0);
+}
@@ -1,8 +0,0 @@
-#version 430
-in vec3 color;
-out vec4 fragColor;
-
-void main()
-{
-    fragColor = vec4(color, 1.0);
-}
@@ -1,26 +1,41 @@
 #include "Buffer.h"
+#include "StateCache.h"
+#include "Window.h"
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 static GLuint f_vao = GL_NONE;
 static GLuint f_vbo = GL_NONE;
 static GLuint f_ibo = GL_NONE;
 
+// Direct state access needs created objects, generated names don't exist until first bound
 GLuint CreateVertexArray()
 {
 	GLuint vao;
-	glGenVertexArrays(1, &vao);
+	if (HasDirectStateAccess())
+		glCreateVertexArrays(1, &vao);
+	else
+		glGenVertexArrays(1, &vao);
 	return vao;
 }
 
 GLuint CreateBuffer()
 {
 	GLuint buffer;
-	glGenBuffers(1, &buffer);
+	if (HasDirectStateAccess())
+		glCreateBuffers(1, &buffer);
+	else
+		glGenBuffers(1, &buffer);
 	return buffer;
 }
 
 void DestroyVertexArray(GLuint* vao)
 {
+	ForgetVertexArray(*vao);
 	glDeleteVertexArrays(1, vao);
 	*vao = GL_NONE;
 }
@@ -34,15 +49,14 @@ void DestroyBuffer(GLuint* buffer)
 void BindVertexArray(GLuint vao)
 {
 	assert(f_vao == GL_NONE);
-	glBindVertexArray(vao);
+	CacheBindVertexArray(vao);
 	f_vao = vao;
 }
 
 void UnbindVertexArray(GLuint vao)
 {
 	assert(vao == f_vao && f_vao != GL_NONE);
-	glBindVertexArray(GL_NONE);
-	f_vao = GL_NONE;
+	f_vao = GL_NONE;	// Left bound in GL until another vertex array is needed
 }
 
 void BindVertexBuffer(GLuint vbo)
@@ -62,6 +76,10 @@ void UnbindVertexBuffer(GLuint vbo)
 void BindIndexBuffer(GLuint ebo)
 {
 	assert(f_ibo == GL_NONE);
+
+	// The index buffer binding belongs to the bound vertex array, so make sure an unbound one isn't lingering
+	if (f_vao == GL_NONE)
+		CacheBindVertexArray(GL_NONE);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
 	f_ibo = ebo;
 }
@@ -69,6 +87,8 @@ void BindIndexBuffer(GLuint ebo)
 void UnbindIndexBuffer(GLuint ebo)
 {
 	assert(ebo == f_ibo && f_ibo != GL_NONE);
+	if (f_vao == GL_NONE)
+		CacheBindVertexArray(GL_NONE);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_NONE);
 	f_ibo = GL_NONE;
 }
@@ -83,10 +103,71 @@ void DisableVertexAttribute(GLuint index)
 	glDisableVertexAttribArray(index);
 }
 
-void SetVertexAttribute(GLuint index, GLint compSize, GLenum type, GLsizei stride/*, int offset*/)
+void SetVertexAttribute(GLuint index, GLint compSize, GLenum type, GLsizei stride, int offset, bool normalized)
+{
+	// With a vertex buffer bound, the "pointer" is a byte offset into it
+	glVertexAttribPointer(index, compSize, type, normalized ? GL_TRUE : GL_FALSE, stride, (const void*)(intptr_t)offset);
+}
+
+void SetVertexAttributeInteger(GLuint index, GLint compSize, GLenum type, GLsizei stride, int offset)
+{
+	glVertexAttribIPointer(index, compSize, type, stride, (const void*)(intptr_t)offset);
+}
+
+void SetVertexAttributeDivisor(GLuint index, GLuint divisor)
+{
+	glVertexAttribDivisor(index, divisor);
+}
+
+void EnableVertexArrayAttribute(GLuint vao, GLuint index)
+{
+	assert(HasDirectStateAccess());
+	glEnableVertexArrayAttrib(vao, index);
+}
+
+void SetVertexArrayAttribute(GLuint vao, GLuint index, GLint compSize, GLenum type, int offset, bool normalized, GLuint binding)
+{
+	assert(HasDirectStateAccess());
+	glVertexArrayAttribFormat(vao, index, compSize, type, normalized ? GL_TRUE : GL_FALSE, offset);
+	glVertexArrayAttribBinding(vao, index, binding);
+}
+
+void SetVertexArrayAttributeInteger(GLuint vao, GLuint index, GLint compSize, GLenum type, int offset, GLuint binding)
+{
+	assert(HasDirectStateAccess());
+	glVertexArrayAttribIFormat(vao, index, compSize, type, offset);
+	glVertexArrayAttribBinding(vao, index, binding);
+}
+
+void SetVertexArrayBuffer(GLuint vao, GLuint binding, GLuint vbo, int offset, GLsizei stride)
+{
+	assert(HasDirectStateAccess());
+	glVertexArrayVertexBuffer(vao, binding, vbo, offset, stride);
+}
+
+void SetVertexArrayIndexBuffer(GLuint vao, GLuint ebo)
+{
+	assert(HasDirectStateAccess());
+	glVertexArrayElementBuffer(vao, ebo);
+}
+
+void SetVertexArrayDivisor(GLuint vao, GLuint binding, GLuint divisor)
 {
-	// No interleaved vertex data in order to simplify our interface (offset is always nullptr)
-	glVertexAttribPointer(index, compSize, type, GL_FALSE, stride, nullptr);
+	assert(HasDirectStateAccess());
+	glVertexArrayBindingDivisor(vao, binding, divisor);
+}
+
+void UpdateBuffer(GLuint buffer, const void* data, int data_size)
+{
+	if (HasDirectStateAccess())
+	{
+		glNamedBufferData(buffer, data_size, data, GL_STATIC_DRAW);
+		return;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, data_size, data, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, GL_NONE);
 }
 
 void UpdateVertexBuffer(void* data, int data_size)
@@ -95,8 +176,528 @@ void UpdateVertexBuffer(void* data, int data_size)
 	glBufferData(GL_ARRAY_BUFFER, data_size, data, GL_STATIC_DRAW);
 }
 
-void UpdateElementBuffer(void* data, int data_size)
+void UpdateElementBuffer(void* data, int count, GLenum type)
+{
+	assert(f_ibo != GL_NONE);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * IndexTypeSize(type), data, GL_STATIC_DRAW);
+}
+
+void UpdateVertexBufferRange(const void* data, int offset, int data_size)
+{
+	assert(f_vbo != GL_NONE);
+	glBufferSubData(GL_ARRAY_BUFFER, offset, data_size, data);
+}
+
+void UpdateElementBufferRange(const void* data, int offset, int data_size)
 {
 	assert(f_ibo != GL_NONE);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, data_size, data, GL_STATIC_DRAW);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, data_size, data);
+}
+
+void CopyBuffer(GLuint source, GLuint destination, int data_size)
+{
+	if (HasDirectStateAccess())
+	{
+		glCopyNamedBufferSubData(source, destination, 0, 0, data_size);
+		return;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, source);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, data_size);
+	glBindBuffer(GL_COPY_READ_BUFFER, GL_NONE);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, GL_NONE);
+}
+
+int IndexTypeSize(GLenum type)
+{
+	switch (type)
+	{
+	case GL_UNSIGNED_BYTE:
+		return sizeof(uint8_t);
+
+	case GL_UNSIGNED_SHORT:
+		return sizeof(uint16_t);
+
+	case GL_UNSIGNED_INT:
+		return sizeof(uint32_t);
+	}
+
+	assert(false);
+	return 0;
+}
+
+static int FindLastSet(uint32_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, value);
+	return (int)index;
+#else
+	return 31 - __builtin_clz(value);
+#endif
+}
+
+static int FindFirstSet(uint32_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return (int)index;
+#else
+	return __builtin_ctz(value);
+#endif
+}
+
+// Size classes count granules: class (0, sl) holds exactly sl granules, above that
+// class (fl, sl) covers [2^(fl+3) + sl * 2^(fl-1), 2^(fl+3) + (sl+1) * 2^(fl-1)) granules
+static void MapSize(int units, int* fl, int* sl)
+{
+	if (units < BUFFER_POOL_SL_COUNT)
+	{
+		*fl = 0;
+		*sl = units;
+		return;
+	}
+
+	int last = FindLastSet((uint32_t)units);
+	*fl = last - BUFFER_POOL_SL_BITS + 1;
+	*sl = (units >> (last - BUFFER_POOL_SL_BITS)) - BUFFER_POOL_SL_COUNT;
+}
+
+// Smallest size whose class only holds blocks of at least units granules
+static int RoundUpSize(int units)
+{
+	if (units < BUFFER_POOL_SL_COUNT)
+		return units;
+
+	int step = 1 << (FindLastSet((uint32_t)units) - BUFFER_POOL_SL_BITS);
+	return (units + step - 1) & ~(step - 1);
+}
+
+static int RoundUp(int value, int multiple)
+{
+	return (value + multiple - 1) / multiple * multiple;
+}
+
+static int NewBlock(BufferPool* pool)
+{
+	if (pool->unused_blocks.empty())
+	{
+		pool->blocks.push_back(BufferBlock());
+		return (int)pool->blocks.size() - 1;
+	}
+
+	int index = pool->unused_blocks.back();
+	pool->unused_blocks.pop_back();
+	pool->blocks[index] = BufferBlock();
+	return index;
+}
+
+static void InsertFreeBlock(BufferPool* pool, int index)
+{
+	BufferBlock& block = pool->blocks[index];
+	BufferSlab& slab = pool->slabs[block.slab];
+	int fl, sl;
+	MapSize(block.size / BUFFER_POOL_GRANULARITY, &fl, &sl);
+
+	block.free = true;
+	block.prev_free = -1;
+	block.next_free = slab.free_lists[fl][sl];
+	if (block.next_free >= 0)
+		pool->blocks[block.next_free].prev_free = index;
+	slab.free_lists[fl][sl] = index;
+	slab.first_level |= 1u << fl;
+	slab.second_level[fl] |= 1u << sl;
+}
+
+static void RemoveFreeBlock(BufferPool* pool, int index)
+{
+	BufferBlock& block = pool->blocks[index];
+	BufferSlab& slab = pool->slabs[block.slab];
+	int fl, sl;
+	MapSize(block.size / BUFFER_POOL_GRANULARITY, &fl, &sl);
+
+	if (block.prev_free >= 0)
+		pool->blocks[block.prev_free].next_free = block.next_free;
+	else
+		slab.free_lists[fl][sl] = block.next_free;
+	if (block.next_free >= 0)
+		pool->blocks[block.next_free].prev_free = block.prev_free;
+
+	if (slab.free_lists[fl][sl] < 0)
+	{
+		slab.second_level[fl] &= ~(1u << sl);
+		if (slab.second_level[fl] == 0)
+			slab.first_level &= ~(1u << fl);
+	}
+	block.free = false;
+}
+
+// Any block in the first non-empty class at or above the rounded-up size fits, so this is O(1)
+static int FindFreeBlock(const BufferSlab& slab, int units)
+{
+	int fl, sl;
+	MapSize(RoundUpSize(units), &fl, &sl);
+	if (fl >= BUFFER_POOL_FL_COUNT)
+		return -1;
+
+	uint32_t sl_map = slab.second_level[fl] & (~0u << sl);
+	if (sl_map == 0)
+	{
+		uint32_t fl_map = slab.first_level & (~0u << (fl + 1));
+		if (fl_map == 0)
+			return -1;
+		fl = FindFirstSet(fl_map);
+		sl_map = slab.second_level[fl];
+	}
+	return slab.free_lists[fl][FindFirstSet(sl_map)];
+}
+
+static int CreateSlab(BufferPool* pool, int size)
+{
+	BufferSlab slab;
+	slab.size = size;
+	for (int fl = 0; fl < BUFFER_POOL_FL_COUNT; fl++)
+	{
+		slab.second_level[fl] = 0;
+		for (int sl = 0; sl < BUFFER_POOL_SL_COUNT; sl++)
+			slab.free_lists[fl][sl] = -1;
+	}
+
+	slab.buffer = CreateBuffer();
+	if (HasDirectStateAccess())
+	{
+		glNamedBufferData(slab.buffer, size, nullptr, pool->usage);
+	}
+	else
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, slab.buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, pool->usage);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, GL_NONE);
+	}
+	pool->slabs.push_back(slab);
+
+	int index = NewBlock(pool);
+	pool->blocks[index].slab = (int)pool->slabs.size() - 1;
+	pool->blocks[index].size = size;
+	InsertFreeBlock(pool, index);
+	return pool->blocks[index].slab;
+}
+
+// Returns a block to its slab's free lists, merged with free neighbours
+static void ReleaseBlock(BufferPool* pool, int index)
+{
+	BufferBlock* block = &pool->blocks[index];
+	pool->used -= block->size;
+	pool->allocation_count--;
+
+	int next = block->next_physical;
+	if (next >= 0 && pool->blocks[next].free)
+	{
+		RemoveFreeBlock(pool, next);
+		block->size += pool->blocks[next].size;
+		block->next_physical = pool->blocks[next].next_physical;
+		if (block->next_physical >= 0)
+			pool->blocks[block->next_physical].prev_physical = index;
+		pool->unused_blocks.push_back(next);
+	}
+
+	int prev = block->prev_physical;
+	if (prev >= 0 && pool->blocks[prev].free)
+	{
+		RemoveFreeBlock(pool, prev);
+		BufferBlock& merged = pool->blocks[prev];
+		merged.size += block->size;
+		merged.next_physical = block->next_physical;
+		if (merged.next_physical >= 0)
+			pool->blocks[merged.next_physical].prev_physical = prev;
+		pool->unused_blocks.push_back(index);
+		index = prev;
+	}
+
+	InsertFreeBlock(pool, index);
+}
+
+void CreateBufferPool(BufferPool* pool, int slab_size, GLenum usage)
+{
+	assert(pool->slabs.empty() && slab_size > 0);
+	*pool = BufferPool();
+	pool->slab_size = RoundUp(slab_size, BUFFER_POOL_GRANULARITY);
+	pool->usage = usage;
+}
+
+void DestroyBufferPool(BufferPool* pool)
+{
+	for (BufferSlab& slab : pool->slabs)
+		DestroyBuffer(&slab.buffer);
+	*pool = BufferPool();
+}
+
+bool AllocateBuffer(BufferPool* pool, int size, int alignment, BufferAllocation* allocation)
+{
+	assert(size > 0 && alignment > 0);
+	assert(allocation->block < 0);
+
+	// Blocks start on a granule, so only alignments the granule isn't a multiple of need padding
+	int padded = BUFFER_POOL_GRANULARITY % alignment == 0 ? size : size + alignment - 1;
+	int units = RoundUp(padded, BUFFER_POOL_GRANULARITY) / BUFFER_POOL_GRANULARITY;
+
+	int index = -1;
+	for (const BufferSlab& slab : pool->slabs)
+	{
+		index = FindFreeBlock(slab, units);
+		if (index >= 0)
+			break;
+	}
+
+	if (index < 0)
+	{
+		int slab_size = std::max(pool->slab_size, RoundUpSize(units) * BUFFER_POOL_GRANULARITY);
+		if (slab_size <= 0)
+		{
+			printf("Warning: buffer pool can't allocate %i bytes\n", size);
+			return false;
+		}
+		index = FindFreeBlock(pool->slabs[CreateSlab(pool, slab_size)], units);
+		assert(index >= 0);
+	}
+
+	RemoveFreeBlock(pool, index);
+
+	// Split off the rest of the block unless it's exactly the size we need
+	int bytes = units * BUFFER_POOL_GRANULARITY;
+	if (pool->blocks[index].size > bytes)
+	{
+		int rest = NewBlock(pool);
+		BufferBlock& block = pool->blocks[index];
+		BufferBlock& remainder = pool->blocks[rest];
+		remainder.slab = block.slab;
+		remainder.offset = block.offset + bytes;
+		remainder.size = block.size - bytes;
+		remainder.prev_physical = index;
+		remainder.next_physical = block.next_physical;
+		if (remainder.next_physical >= 0)
+			pool->blocks[remainder.next_physical].prev_physical = rest;
+		block.next_physical = rest;
+		block.size = bytes;
+		InsertFreeBlock(pool, rest);
+	}
+
+	const BufferBlock& block = pool->blocks[index];
+	pool->used += block.size;
+	pool->allocation_count++;
+
+	allocation->buffer = pool->slabs[block.slab].buffer;
+	allocation->offset = RoundUp(block.offset, alignment);
+	allocation->size = size;
+	allocation->slab = block.slab;
+	allocation->block = index;
+	return true;
+}
+
+void FreeBuffer(BufferPool* pool, BufferAllocation* allocation)
+{
+	if (allocation->block < 0)
+		return;
+
+	assert(!pool->blocks[allocation->block].free);
+	BufferPendingFree pending;
+	pending.block = allocation->block;
+	pending.frame = pool->frame;
+	pool->pending_frees.push_back(pending);
+	*allocation = BufferAllocation();
+}
+
+void AdvanceBufferPool(BufferPool* pool)
+{
+	pool->frame++;
+
+	// Frees are queued in frame order
+	size_t released = 0;
+	while (released < pool->pending_frees.size() && pool->frame - pool->pending_frees[released].frame >= BUFFER_POOL_FREE_DELAY)
+		ReleaseBlock(pool, pool->pending_frees[released++].block);
+	pool->pending_frees.erase(pool->pending_frees.begin(), pool->pending_frees.begin() + released);
+}
+
+void UpdateBufferAllocation(const BufferAllocation& allocation, const void* data, int data_size, int offset)
+{
+	assert(allocation.block >= 0 && offset + data_size <= allocation.size);
+	if (HasDirectStateAccess())
+	{
+		glNamedBufferSubData(allocation.buffer, allocation.offset + offset, data_size, data);
+		return;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.offset + offset, data_size, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, GL_NONE);
+}
+
+BufferPoolStats GetBufferPoolStats(const BufferPool& pool)
+{
+	BufferPoolStats stats;
+	stats.slab_count = (int)pool.slabs.size();
+	stats.allocation_count = pool.allocation_count;
+	stats.pending_free_count = (int)pool.pending_frees.size();
+	stats.used = pool.used;
+
+	int64_t slab_largest_free = 0;
+	for (const BufferSlab& slab : pool.slabs)
+	{
+		stats.capacity += slab.size;
+		if (slab.first_level == 0)
+			continue;
+
+		// The largest block is in the highest non-empty class, whose list isn't sorted
+		int fl = FindLastSet(slab.first_level);
+		int sl = FindLastSet(slab.second_level[fl]);
+		int64_t largest = 0;
+		for (int i = slab.free_lists[fl][sl]; i >= 0; i = pool.blocks[i].next_free)
+			largest = std::max(largest, (int64_t)pool.blocks[i].size);
+
+		stats.largest_free = std::max(stats.largest_free, largest);
+		slab_largest_free += largest;
+	}
+
+	int64_t free = stats.capacity - stats.used;
+	stats.utilization = stats.capacity > 0 ? stats.used / (float)stats.capacity : 0.0f;
+	stats.fragmentation = free > 0 ? 1.0f - slab_largest_free / (float)free : 0.0f;
+	return stats;
+}
+
+static bool HasBufferStorage()
+{
+	return GLAD_GL_VERSION_4_4 && glBufferStorage != nullptr;
+}
+
+void CreateStreamBuffer(StreamBuffer* stream, int frame_size)
+{
+	assert(stream->buffer == GL_NONE && frame_size > 0);
+	*stream = StreamBuffer();
+	stream->frame_size = RoundUp(frame_size, STREAM_BUFFER_ALIGNMENT);
+	int size = stream->frame_size * STREAM_BUFFER_FRAMES;
+
+	stream->buffer = CreateBuffer();
+
+	// Coherent, so writes are visible to the GPU without flushing
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	if (HasDirectStateAccess())
+	{
+		// Direct state access is GL 4.5, which always has buffer storage
+		glNamedBufferStorage(stream->buffer, size, nullptr, flags);
+		stream->mapped = (uint8_t*)glMapNamedBufferRange(stream->buffer, 0, size, flags);
+		return;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+	if (HasBufferStorage())
+	{
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+		stream->mapped = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+	}
+	else
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, GL_NONE);
+}
+
+void DestroyStreamBuffer(StreamBuffer* stream)
+{
+	for (GLsync& fence : stream->fences)
+	{
+		if (fence != nullptr)
+			glDeleteSync(fence);
+	}
+
+	// Deleting a buffer unmaps it
+	if (stream->buffer != GL_NONE)
+		DestroyBuffer(&stream->buffer);
+	*stream = StreamBuffer();
+}
+
+void AdvanceStreamBuffer(StreamBuffer* stream)
+{
+	assert(stream->fences[stream->region] == nullptr);
+	stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	stream->region = (stream->region + 1) % STREAM_BUFFER_FRAMES;
+	stream->head = 0;
+
+	GLsync fence = stream->fences[stream->region];
+	if (fence == nullptr)
+		return;
+
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED && stream->mapped == nullptr)
+	{
+		// The GPU is more than STREAM_BUFFER_FRAMES - 1 frames behind. Rather than wait, give the driver back the
+		// whole buffer (draws in flight keep the old storage), which leaves every region free to write.
+		glBindBuffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, stream->frame_size * STREAM_BUFFER_FRAMES, nullptr, GL_STREAM_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, GL_NONE);
+		for (GLsync& other : stream->fences)
+		{
+			if (other != nullptr)
+				glDeleteSync(other);
+			other = nullptr;
+		}
+		return;
+	}
+
+	// Persistent mappings can't be orphaned, so wait (flushing in case the fence hasn't been submitted yet)
+	while (status == GL_TIMEOUT_EXPIRED)
+		status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	if (status == GL_WAIT_FAILED)
+		printf("Warning: stream buffer fence wait failed\n");
+
+	glDeleteSync(fence);
+	stream->fences[stream->region] = nullptr;
+}
+
+void AllocateStream(StreamBuffer* stream, int size, int alignment, StreamAllocation* allocation)
+{
+	assert(stream->buffer != GL_NONE && size > 0 && alignment > 0);
+	assert(STREAM_BUFFER_ALIGNMENT % alignment == 0);
+
+	int offset = RoundUp(stream->head, alignment);
+	if (offset + size > stream->frame_size)
+	{
+		int frame_size = std::max(stream->frame_size * 2, size);
+		printf("Growing stream buffer to %i bytes per frame\n", frame_size);
+
+		// The old buffer lives on until draws using it are done
+		DestroyStreamBuffer(stream);
+		CreateStreamBuffer(stream, frame_size);
+		offset = 0;
+	}
+
+	allocation->buffer = stream->buffer;
+	allocation->offset = stream->region * stream->frame_size + offset;
+	allocation->size = size;
+	stream->head = offset + size;
+
+	if (stream->mapped != nullptr)
+	{
+		allocation->data = stream->mapped + allocation->offset;
+	}
+	else
+	{
+		// Fences already keep us off ranges the GPU is reading, so the driver needn't synchronize
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+		allocation->data = glMapBufferRange(GL_COPY_WRITE_BUFFER, allocation->offset, size, flags);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, GL_NONE);
+	}
+}
+
+void FinishStreamAllocation(StreamBuffer* stream, StreamAllocation* allocation)
+{
+	if (stream->mapped == nullptr && allocation->data != nullptr)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, allocation->buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, GL_NONE);
+	}
+	allocation->data = nullptr;
 }
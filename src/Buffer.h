@@ -1,4 +1,6 @@
 #pragma once
+#include <cstdint>
+#include <vector>
 #include <glad/glad.h>
 #include "raymath.h"
 
@@ -20,7 +22,227 @@ void UnbindIndexBuffer(GLuint ebo);
 void EnableVertexAttribute(GLuint index);
 void DisableVertexAttribute(GLuint index);
 
-void SetVertexAttribute(GLuint index, GLint compSize, GLenum type, GLsizei stride);
+// offset is the attribute's byte offset within an interleaved vertex, normalized maps integer types to [0, 1] or [-1, 1]
+void SetVertexAttribute(GLuint index, GLint compSize, GLenum type, GLsizei stride, int offset = 0, bool normalized = false);
+
+// Integer attributes reach the shader unconverted (in int/uint), type is one of the integer GL types
+void SetVertexAttributeInteger(GLuint index, GLint compSize, GLenum type, GLsizei stride, int offset = 0);
+
+// Advance the attribute once every divisor instances instead of every vertex (0 = per-vertex)
+void SetVertexAttributeDivisor(GLuint index, GLuint divisor);
+
+// Direct state access versions (HasDirectStateAccess() only): edit vao without binding it.
+// Attributes read from a numbered buffer binding point, so the format is set once and buffers can be swapped per draw.
+void EnableVertexArrayAttribute(GLuint vao, GLuint index);
+void SetVertexArrayAttribute(GLuint vao, GLuint index, GLint compSize, GLenum type, int offset = 0, bool normalized = false, GLuint binding = 0);
+void SetVertexArrayAttributeInteger(GLuint vao, GLuint index, GLint compSize, GLenum type, int offset = 0, GLuint binding = 0);
+void SetVertexArrayBuffer(GLuint vao, GLuint binding, GLuint vbo, int offset, GLsizei stride);
+void SetVertexArrayIndexBuffer(GLuint vao, GLuint ebo);
+void SetVertexArrayDivisor(GLuint vao, GLuint binding, GLuint divisor);
 
 void UpdateVertexBuffer(void* data, int data_size);
-void UpdateElementBuffer(void* data, int data_size);
\ No newline at end of file
+void UpdateElementBuffer(void* data, int count, GLenum type);	// type is GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+
+// Overwrite part of the bound buffer (allocate it first with data = nullptr)
+void UpdateVertexBufferRange(const void* data, int offset, int data_size);
+void UpdateElementBufferRange(const void* data, int offset, int data_size);
+
+// (Re)allocates buffer with data without disturbing the vertex or index buffer bindings
+void UpdateBuffer(GLuint buffer, const void* data, int data_size);
+
+// Copies the start of source into destination without disturbing the vertex or index buffer bindings
+void CopyBuffer(GLuint source, GLuint destination, int data_size);
+
+int IndexTypeSize(GLenum type);
+
+// Pooled GPU memory: allocations are ranges of a few large buffers ("slabs") handed out by a two-level
+// segregated fit (TLSF) allocator, so loading & unloading doesn't create and destroy driver buffers.
+// Block bookkeeping lives on the CPU, the slabs only hold the data.
+#define BUFFER_POOL_GRANULARITY 16		// Every block starts & ends on a multiple of this
+#define BUFFER_POOL_SL_BITS 4			// Each power of 2 size class is split into 16 linear ones
+#define BUFFER_POOL_SL_COUNT (1 << BUFFER_POOL_SL_BITS)
+#define BUFFER_POOL_FL_COUNT 28			// Enough classes for 2GB blocks
+#define BUFFER_POOL_FREE_DELAY 3		// Frames a freed range stays reserved since the GPU may still be reading it
+
+struct BufferAllocation
+{
+	GLuint buffer = GL_NONE;	// Slab the range lives in
+	int offset = 0;				// Bytes from the start of buffer, a multiple of the requested alignment
+	int size = 0;
+	int slab = -1;
+	int block = -1;				// -1 if nothing is allocated
+};
+
+struct BufferBlock
+{
+	int offset = 0;
+	int size = 0;
+	int slab = -1;
+	int prev_physical = -1;		// Neighbours within the slab, for merging free blocks
+	int next_physical = -1;
+	int prev_free = -1;			// Neighbours within the block's free list
+	int next_free = -1;
+	bool free = false;
+};
+
+struct BufferSlab
+{
+	GLuint buffer = GL_NONE;
+	int size = 0;
+	uint32_t first_level = 0;								// Bit fl is set if any free list of size class fl is non-empty
+	uint32_t second_level[BUFFER_POOL_FL_COUNT];			// Bit sl is set if free_lists[fl][sl] is non-empty
+	int free_lists[BUFFER_POOL_FL_COUNT][BUFFER_POOL_SL_COUNT];
+};
+
+struct BufferPendingFree
+{
+	int block;
+	int frame;
+};
+
+struct BufferPool
+{
+	std::vector<BufferSlab> slabs;
+	std::vector<BufferBlock> blocks;
+	std::vector<int> unused_blocks;			// Recycled entries of blocks
+	std::vector<BufferPendingFree> pending_frees;
+
+	int slab_size = 0;		// Allocations larger than this get a slab of their own
+	GLenum usage = GL_STATIC_DRAW;
+	int frame = 0;
+	int allocation_count = 0;
+	int64_t used = 0;		// Bytes in allocated blocks (including alignment padding & pending frees)
+};
+
+struct BufferPoolStats
+{
+	int slab_count = 0;
+	int allocation_count = 0;
+	int pending_free_count = 0;
+	int64_t capacity = 0;
+	int64_t used = 0;
+	int64_t largest_free = 0;		// Biggest allocation that fits without a new slab
+	float utilization = 0.0f;		// used / capacity
+	float fragmentation = 0.0f;		// Share of free bytes outside each slab's largest free block, 0 when no slab has holes
+};
+
+void CreateBufferPool(BufferPool* pool, int slab_size, GLenum usage = GL_STATIC_DRAW);
+void DestroyBufferPool(BufferPool* pool);
+
+// Returns false (and prints a warning) only if a new slab couldn't be created
+bool AllocateBuffer(BufferPool* pool, int size, int alignment, BufferAllocation* allocation);
+
+// The range is reused BUFFER_POOL_FREE_DELAY frames later (see AdvanceBufferPool)
+void FreeBuffer(BufferPool* pool, BufferAllocation* allocation);
+
+// Call once per frame, releases frees old enough that no draw in flight can reference them
+void AdvanceBufferPool(BufferPool* pool);
+
+// Overwrite part of an allocation (through GL_COPY_WRITE_BUFFER so no other binding is disturbed)
+void UpdateBufferAllocation(const BufferAllocation& allocation, const void* data, int data_size, int offset = 0);
+
+BufferPoolStats GetBufferPoolStats(const BufferPool& pool);
+
+// Packed attribute types for quantized vertices
+struct Unorm16x2 { uint16_t x, y; };
+struct Unorm16x4 { uint16_t x, y, z, w; };
+struct Snorm16x2 { int16_t x, y; };
+
+// How the GPU reads each attribute type
+template <typename T> struct VertexAttributeFormat;
+template <> struct VertexAttributeFormat<Vector2> { enum { size = 2, type = GL_FLOAT, normalized = false }; };
+template <> struct VertexAttributeFormat<Vector3> { enum { size = 3, type = GL_FLOAT, normalized = false }; };
+template <> struct VertexAttributeFormat<Vector4> { enum { size = 4, type = GL_FLOAT, normalized = false }; };
+template <> struct VertexAttributeFormat<Unorm16x2> { enum { size = 2, type = GL_UNSIGNED_SHORT, normalized = true }; };
+template <> struct VertexAttributeFormat<Unorm16x4> { enum { size = 4, type = GL_UNSIGNED_SHORT, normalized = true }; };
+template <> struct VertexAttributeFormat<Snorm16x2> { enum { size = 2, type = GL_SHORT, normalized = true }; };
+
+template <GLuint Index, int Offset, typename... Attributes>
+struct VertexLayoutAttributes
+{
+	enum { size = 0 };
+	static void Set(GLsizei) {}
+	static void SetFormat(GLuint) {}
+};
+
+template <GLuint Index, int Offset, typename Attribute, typename... Attributes>
+struct VertexLayoutAttributes<Index, Offset, Attribute, Attributes...>
+{
+	typedef VertexAttributeFormat<Attribute> Format;
+	typedef VertexLayoutAttributes<Index + 1, Offset + sizeof(Attribute), Attributes...> Next;
+	enum { size = sizeof(Attribute) + Next::size };
+
+	static void Set(GLsizei stride)
+	{
+		EnableVertexAttribute(Index);
+		SetVertexAttribute(Index, Format::size, Format::type, stride, Offset, Format::normalized);
+		Next::Set(stride);
+	}
+
+	static void SetFormat(GLuint vao)
+	{
+		EnableVertexArrayAttribute(vao, Index);
+		SetVertexArrayAttribute(vao, Index, Format::size, Format::type, Offset, Format::normalized);
+		Next::SetFormat(vao);
+	}
+};
+
+// Interleaved vertex of tightly packed attributes bound to locations 0, 1, 2... in order.
+// static_assert(sizeof(Vertex) == Layout::stride) to catch struct padding.
+template <typename... Attributes>
+struct VertexLayout
+{
+	typedef VertexLayoutAttributes<0, 0, Attributes...> Root;
+	enum { count = sizeof...(Attributes), stride = Root::size };
+
+	// Points every attribute at the bound vertex buffer (the vertex array must be bound too)
+	static void Set()
+	{
+		Root::Set(stride);
+	}
+
+	// Direct state access version: reads every attribute from vao's buffer binding 0 (see SetVertexArrayBuffer)
+	static void SetFormat(GLuint vao)
+	{
+		Root::SetFormat(vao);
+	}
+};
+
+// Per-frame data (instance transforms, indirect commands...) written straight into GPU-visible memory.
+// The buffer is split into STREAM_BUFFER_FRAMES regions: each frame bump-allocates from one region while
+// the GPU reads the others, and a fence per region says when it can be rewritten.
+// With GL 4.4 the buffer is persistently mapped (glBufferStorage), otherwise each allocation is mapped
+// unsynchronized and a region still in use gets the whole buffer orphaned instead of waiting on it.
+#define STREAM_BUFFER_FRAMES 3
+#define STREAM_BUFFER_ALIGNMENT 256		// Regions start on a multiple of this, the largest offset alignment GL asks for
+
+struct StreamAllocation
+{
+	GLuint buffer = GL_NONE;
+	int offset = 0;			// Bytes from the start of buffer
+	int size = 0;
+	void* data = nullptr;	// Write-only, valid until FinishStreamAllocation
+};
+
+struct StreamBuffer
+{
+	GLuint buffer = GL_NONE;
+	int frame_size = 0;		// Bytes per region
+	int region = 0;			// Region this frame allocates from
+	int head = 0;			// Bytes allocated from it so far
+	GLsync fences[STREAM_BUFFER_FRAMES] = {};
+	uint8_t* mapped = nullptr;	// The whole buffer if it's persistently mapped
+};
+
+void CreateStreamBuffer(StreamBuffer* stream, int frame_size);
+void DestroyStreamBuffer(StreamBuffer* stream);
+
+// Call once per frame after the frame's draws: fences this frame's region and moves on to the next
+void AdvanceStreamBuffer(StreamBuffer* stream);
+
+// Bump-allocates size bytes of this frame's region. If the region is full, the stream is recreated twice as large,
+// so finish each allocation before making the next.
+void AllocateStream(StreamBuffer* stream, int size, int alignment, StreamAllocation* allocation);
+
+// Call before drawing with the allocation (unmaps it unless the buffer is persistently mapped)
+void FinishStreamAllocation(StreamBuffer* stream, StreamAllocation* allocation);
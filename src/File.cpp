@@ -0,0 +1,148 @@
+#include "File.h"
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Platform headers stay in this file only since windows.h defines macros like CreateWindow and LoadImage
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool MapFile(MappedFile* file, const char* path)
+{
+    assert(file->data == nullptr);
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(handle);
+        return false;
+    }
+
+    file->data = (const uint8_t*)data;
+    file->size = (size_t)size.QuadPart;
+    file->file = handle;
+    file->mapping = mapping;
+    return true;
+}
+
+void UnmapFile(MappedFile* file)
+{
+    if (file->data != nullptr)
+        UnmapViewOfFile(file->data);
+    if (file->mapping != nullptr)
+        CloseHandle((HANDLE)file->mapping);
+    if (file->file != nullptr)
+        CloseHandle((HANDLE)file->file);
+    *file = MappedFile{};
+}
+
+bool FileInfo(const char* path, uint64_t* size, uint64_t* mtime)
+{
+    struct _stat64 info;
+    if (_stat64(path, &info) != 0)
+        return false;
+
+    *size = (uint64_t)info.st_size;
+    *mtime = (uint64_t)info.st_mtime;
+    return true;
+}
+
+bool MakeDirectory(const char* path)
+{
+    return _mkdir(path) == 0 || errno == EEXIST;
+}
+#else
+bool MapFile(MappedFile* file, const char* path)
+{
+    assert(file->data == nullptr);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps its own reference to the file
+    if (data == MAP_FAILED)
+        return false;
+
+    madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+    file->data = (const uint8_t*)data;
+    file->size = (size_t)info.st_size;
+    return true;
+}
+
+void UnmapFile(MappedFile* file)
+{
+    if (file->data != nullptr)
+        munmap((void*)file->data, file->size);
+    *file = MappedFile{};
+}
+
+bool FileInfo(const char* path, uint64_t* size, uint64_t* mtime)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return false;
+
+    *size = (uint64_t)info.st_size;
+    *mtime = (uint64_t)info.st_mtime;
+    return true;
+}
+
+bool MakeDirectory(const char* path)
+{
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+#endif
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t HashString(const char* str, uint64_t seed)
+{
+    return HashBytes(str, strlen(str), seed);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Read-only view of a file mapped into our address space (no copy into a buffer like fread)
+struct MappedFile
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    void* file = nullptr;       // Platform file handle
+    void* mapping = nullptr;    // Platform mapping handle
+};
+
+bool MapFile(MappedFile* file, const char* path);
+void UnmapFile(MappedFile* file);
+
+// Size in bytes and last-modified time (seconds since epoch) of the file at path
+bool FileInfo(const char* path, uint64_t* size, uint64_t* mtime);
+
+// Creates a single directory, succeeds if it already exists
+bool MakeDirectory(const char* path);
+
+// 64-bit FNV-1a, used to key on-disk caches
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+uint64_t HashString(const char* str, uint64_t seed = 14695981039346656037ull);
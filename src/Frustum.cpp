@@ -0,0 +1,56 @@
+#include "Frustum.h"
+#include <cmath>
+
+static Vector4 NormalizePlane(Vector4 plane)
+{
+    float length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+    return length > 0.0f ? plane / length : plane;
+}
+
+Frustum FrustumFromMatrix(Matrix m)
+{
+    // Gribb & Hartmann: clip-space -w <= x, y, z <= w becomes row3 +- row(0, 1, 2) in world-space
+    Vector4 row0 = { m.m0, m.m4, m.m8, m.m12 };
+    Vector4 row1 = { m.m1, m.m5, m.m9, m.m13 };
+    Vector4 row2 = { m.m2, m.m6, m.m10, m.m14 };
+    Vector4 row3 = { m.m3, m.m7, m.m11, m.m15 };
+
+    Frustum frustum;
+    frustum.planes[FRUSTUM_LEFT] = NormalizePlane(row3 + row0);
+    frustum.planes[FRUSTUM_RIGHT] = NormalizePlane(row3 - row0);
+    frustum.planes[FRUSTUM_BOTTOM] = NormalizePlane(row3 + row1);
+    frustum.planes[FRUSTUM_TOP] = NormalizePlane(row3 - row1);
+    frustum.planes[FRUSTUM_NEAR] = NormalizePlane(row3 + row2);
+    frustum.planes[FRUSTUM_FAR] = NormalizePlane(row3 - row2);
+    return frustum;
+}
+
+bool SphereInFrustum(const Frustum& frustum, Vector3 center, float radius)
+{
+    for (int i = 0; i < FRUSTUM_PLANE_COUNT; i++)
+    {
+        const Vector4& plane = frustum.planes[i];
+        if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+bool BoxInFrustum(const Frustum& frustum, Vector3 min, Vector3 max)
+{
+    for (int i = 0; i < FRUSTUM_PLANE_COUNT; i++)
+    {
+        // Only the corner furthest along the plane's normal needs testing
+        const Vector4& plane = frustum.planes[i];
+        Vector3 corner =
+        {
+            plane.x >= 0.0f ? max.x : min.x,
+            plane.y >= 0.0f ? max.y : min.y,
+            plane.z >= 0.0f ? max.z : min.z
+        };
+
+        if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0.0f)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "raymath.h"
+
+enum FrustumPlane
+{
+    FRUSTUM_LEFT,
+    FRUSTUM_RIGHT,
+    FRUSTUM_BOTTOM,
+    FRUSTUM_TOP,
+    FRUSTUM_NEAR,
+    FRUSTUM_FAR,
+    FRUSTUM_PLANE_COUNT
+};
+
+// Planes are (normal, distance) with normals facing inwards, so p is inside a plane when dot(normal, p) + distance >= 0
+struct Frustum
+{
+    Vector4 planes[FRUSTUM_PLANE_COUNT];
+};
+
+// Extracts the clip planes of a view-projection matrix (world-space planes from view * proj)
+Frustum FrustumFromMatrix(Matrix view_proj);
+
+// Conservative tests: true if the volume is at least partially inside
+bool SphereInFrustum(const Frustum& frustum, Vector3 center, float radius);
+bool BoxInFrustum(const Frustum& frustum, Vector3 min, Vector3 max);
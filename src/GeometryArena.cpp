@@ -0,0 +1,101 @@
+#include "GeometryArena.h"
+#include "Window.h"
+#include <cassert>
+
+// Index allocations are aligned to the largest index type so any type can follow any other
+#define ARENA_INDEX_ALIGNMENT 4
+
+void CreateGeometryArena(GeometryArena* arena, int vertex_stride, void (*set_layout)(), void (*set_format)(GLuint vao),
+    int vertex_slab_size, int index_slab_size)
+{
+    assert(arena->set_layout == nullptr);
+    arena->vertex_stride = vertex_stride;
+    arena->set_layout = set_layout;
+    arena->set_format = set_format;
+    CreateBufferPool(&arena->vertices, vertex_slab_size * vertex_stride);
+    CreateBufferPool(&arena->indices, index_slab_size);
+}
+
+void DestroyGeometryArena(GeometryArena* arena)
+{
+    for (GeometryArenaVertexArray& vertex_array : arena->vertex_arrays)
+        DestroyVertexArray(&vertex_array.vao);
+    DestroyBufferPool(&arena->vertices);
+    DestroyBufferPool(&arena->indices);
+    *arena = GeometryArena();
+}
+
+int AllocateArenaVertices(GeometryArena* arena, const void* vertices, int count, BufferAllocation* allocation)
+{
+    assert(arena->set_layout != nullptr);
+
+    // Aligning to the stride makes the offset a whole number of vertices
+    int size = count * arena->vertex_stride;
+    AllocateBuffer(&arena->vertices, size, arena->vertex_stride, allocation);
+    UpdateBufferAllocation(*allocation, vertices, size);
+    return allocation->offset / arena->vertex_stride;
+}
+
+int AllocateArenaIndices(GeometryArena* arena, const void* indices, int count, GLenum type, BufferAllocation* allocation)
+{
+    assert(arena->set_layout != nullptr);
+    int size = count * IndexTypeSize(type);
+    AllocateBuffer(&arena->indices, size, ARENA_INDEX_ALIGNMENT, allocation);
+    UpdateBufferAllocation(*allocation, indices, size);
+    return allocation->offset;
+}
+
+void FreeArenaVertices(GeometryArena* arena, BufferAllocation* allocation)
+{
+    FreeBuffer(&arena->vertices, allocation);
+}
+
+void FreeArenaIndices(GeometryArena* arena, BufferAllocation* allocation)
+{
+    FreeBuffer(&arena->indices, allocation);
+}
+
+GLuint ArenaVertexArray(GeometryArena* arena, const BufferAllocation& vertices, const BufferAllocation* indices)
+{
+    int index_slab = indices != nullptr ? indices->slab : -1;
+    for (const GeometryArenaVertexArray& vertex_array : arena->vertex_arrays)
+    {
+        if (vertex_array.vertex_slab == vertices.slab && vertex_array.index_slab == index_slab)
+            return vertex_array.vao;
+    }
+
+    GeometryArenaVertexArray vertex_array;
+    vertex_array.vertex_slab = vertices.slab;
+    vertex_array.index_slab = index_slab;
+    vertex_array.vao = CreateVertexArray();
+
+    if (HasDirectStateAccess())
+    {
+        arena->set_format(vertex_array.vao);
+        SetVertexArrayBuffer(vertex_array.vao, 0, vertices.buffer, 0, arena->vertex_stride);
+        if (indices != nullptr)
+            SetVertexArrayIndexBuffer(vertex_array.vao, indices->buffer);
+        arena->vertex_arrays.push_back(vertex_array);
+        return vertex_array.vao;
+    }
+
+    // The vertex array remembers the index buffer bound while it's bound, so unbind it first
+    BindVertexArray(vertex_array.vao);
+    if (indices != nullptr)
+        BindIndexBuffer(indices->buffer);
+    BindVertexBuffer(vertices.buffer);
+    arena->set_layout();
+    UnbindVertexBuffer(vertices.buffer);
+    UnbindVertexArray(vertex_array.vao);
+    if (indices != nullptr)
+        UnbindIndexBuffer(indices->buffer);
+
+    arena->vertex_arrays.push_back(vertex_array);
+    return vertex_array.vao;
+}
+
+void UpdateGeometryArena(GeometryArena* arena)
+{
+    AdvanceBufferPool(&arena->vertices);
+    AdvanceBufferPool(&arena->indices);
+}
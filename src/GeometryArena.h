@@ -0,0 +1,51 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include "Buffer.h"
+
+// Vertex array for meshes whose vertices & indices live in a given pair of slabs
+struct GeometryArenaVertexArray
+{
+    int vertex_slab;
+    int index_slab;             // -1 for meshes without indices
+    GLuint vao;
+};
+
+// Pooled vertex & index memory that static meshes of one vertex format sub-allocate from.
+// Meshes in the same pair of slabs share a vertex array, so drawing them takes no vertex array switches:
+// indices are relative to each mesh's base vertex (glDrawElementsBaseVertex).
+// With slabs sized for the whole scene that's every mesh of the format.
+// The vertex format takes locations 0-2. Draw paths that need more per-instance data enable it on the shared vertex
+// array themselves: location 3 for MultiDrawBatch draw ids, 4-7 for DrawMeshInstanced transforms. Per-vertex draws
+// never read those locations, so they can stay set up rather than each path needing its own vertex arrays.
+struct GeometryArena
+{
+    BufferPool vertices;
+    BufferPool indices;
+    std::vector<GeometryArenaVertexArray> vertex_arrays;
+
+    int vertex_stride = 0;
+    void (*set_layout)() = nullptr;     // Points the attributes at the bound vertex buffer, usually a VertexLayout<...>::Set
+    void (*set_format)(GLuint vao) = nullptr;   // Direct state access version, reading buffer binding 0 (VertexLayout<...>::SetFormat)
+};
+
+// Slab sizes are in vertices & index bytes
+void CreateGeometryArena(GeometryArena* arena, int vertex_stride, void (*set_layout)(), void (*set_format)(GLuint vao),
+    int vertex_slab_size, int index_slab_size);
+void DestroyGeometryArena(GeometryArena* arena);
+
+// Copies count vertices into the arena and returns the base vertex of the first one
+int AllocateArenaVertices(GeometryArena* arena, const void* vertices, int count, BufferAllocation* allocation);
+
+// Copies count indices of type into the arena and returns the byte offset of the first one
+int AllocateArenaIndices(GeometryArena* arena, const void* indices, int count, GLenum type, BufferAllocation* allocation);
+
+// Space is reused once draws in flight are done with it (see UpdateGeometryArena)
+void FreeArenaVertices(GeometryArena* arena, BufferAllocation* allocation);
+void FreeArenaIndices(GeometryArena* arena, BufferAllocation* allocation);
+
+// The vertex array to draw a mesh with, created on first use. indices is nullptr for meshes without an index buffer.
+GLuint ArenaVertexArray(GeometryArena* arena, const BufferAllocation& vertices, const BufferAllocation* indices);
+
+// Call once per frame
+void UpdateGeometryArena(GeometryArena* arena);
@@ -0,0 +1,126 @@
+#include "Jobs.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct JobBatch
+{
+    const std::function<void(int)>* job = nullptr;
+    int count = 0;
+    std::atomic<int> next{ 0 };     // Next index to claim
+    std::atomic<int> done{ 0 };     // Number of finished indices
+    int workers = 0;                // Worker threads currently holding this batch (guarded by JobPool::mutex)
+};
+
+// Workers are created on first use and live until the program exits
+struct JobPool
+{
+    std::vector<std::thread> workers;
+    std::deque<JobBatch*> batches;
+    std::mutex mutex;
+    std::condition_variable wake;   // Signalled when a batch is added or we're shutting down
+    std::condition_variable finish; // Signalled when a batch completes
+    bool stop = false;
+
+    JobPool()
+    {
+        int count = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+        for (int i = 0; i < count; i++)
+            workers.emplace_back([this] { WorkerLoop(); });
+    }
+
+    ~JobPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    // Claims and runs indices of batch until none are left
+    void Work(JobBatch* batch)
+    {
+        int completed = 0;
+        for (int i = batch->next++; i < batch->count; i = batch->next++)
+        {
+            (*batch->job)(i);
+            completed++;
+        }
+        batch->done += completed;
+    }
+
+    void WorkerLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [this] { return stop || !batches.empty(); });
+            if (stop)
+                return;
+
+            // Batches stay queued until fully claimed so several workers can share one
+            JobBatch* batch = batches.front();
+            if (batch->next >= batch->count)
+            {
+                batches.pop_front();
+                continue;
+            }
+
+            // The owner of the batch waits for us to let go of it before returning
+            batch->workers++;
+            lock.unlock();
+            Work(batch);
+            lock.lock();
+            batch->workers--;
+            finish.notify_all();
+        }
+    }
+};
+
+static JobPool& Pool()
+{
+    static JobPool pool;
+    return pool;
+}
+
+int JobThreadCount()
+{
+    return (int)Pool().workers.size() + 1;
+}
+
+void ParallelFor(int count, const std::function<void(int index)>& job)
+{
+    if (count <= 0)
+        return;
+
+    if (count == 1)
+    {
+        job(0);
+        return;
+    }
+
+    JobPool& pool = Pool();
+    JobBatch batch;
+    batch.job = &job;
+    batch.count = count;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.batches.push_back(&batch);
+    }
+    pool.wake.notify_all();
+
+    pool.Work(&batch);
+
+    // Wait for workers still running our jobs, then make sure no worker can see the batch once we return
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.finish.wait(lock, [&batch] { return batch.done == batch.count && batch.workers == 0; });
+    pool.batches.erase(std::remove(pool.batches.begin(), pool.batches.end(), &batch), pool.batches.end());
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <functional>
+
+// Number of threads that run jobs (worker threads plus the calling thread)
+int JobThreadCount();
+
+// Runs job(0) to job(count - 1) on the worker threads and returns once every job has finished.
+// The calling thread works on the jobs too, so it's safe to call ParallelFor from within a job.
+void ParallelFor(int count, const std::function<void(int index)>& job);
@@ -1,7 +1,17 @@
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjParser.h"
 #include "Buffer.h"
+#include "GeometryArena.h"
+#include "Shader.h"
+#include "Window.h"
+#include <algorithm>
 #include <cstdio>
 #include <cassert>
+#include <cmath>
+#include <unordered_map>
 
 #define PAR_SHAPES_IMPLEMENTATION
 #include <par_shapes/par_shapes.h>
@@ -10,43 +20,115 @@
 #include <fast_obj/fast_obj.h>
 
 void LoadMeshGPU(Mesh* mesh);
+static bool LoadMeshCacheGPU(Mesh* mesh, const char* path);
+static void LoadMeshObjGPU(Mesh* mesh, const char* path);
 void LoadMeshPar(Mesh* mesh, par_shapes_mesh* par);
 void LoadMeshPlaneOptimal(Mesh* mesh);
 void LoadMeshPlaneUnoptimal(Mesh* mesh);
+static void FreeMeshArenaSpace(Mesh* mesh);
 
-void LoadMeshObj(Mesh* mesh, const char* path)
+// Attribute arrays of an obj file (from either fast_obj or ParseObjParallel).
+// Element 0 of each array is a dummy so the file's 1-based indices can be used directly.
+struct ObjView
 {
-    // Follow the same pattern for tcoords and normals if you didn't complete the obj-loader for assignment 3!
-	fastObjMesh* obj = fast_obj_read(path);
+    const Vector3* positions;
+    const Vector2* tcoords;
+    const Vector3* normals;
+    size_t position_count;
+    size_t tcoord_count;
+    size_t normal_count;
+
+    const ObjIndex* indices;
+    const uint32_t* face_vertices;
+    size_t index_count;
+    size_t face_count;
+};
+
+void ImportMeshObj(Mesh* mesh, const ObjView& obj, const char* path);
+void WeldMeshObj(Mesh* mesh, const ObjView& obj);
 
-    size_t vc = obj->index_count;
-    mesh->vertex_count = vc;
-    mesh->positions.resize(vc);
+void LoadMeshObj(Mesh* mesh, const char* path)
+{
+    // Skip parsing entirely if we've already imported this exact file
+    if (LoadMeshCacheGPU(mesh, path))
+        return;
 
-    Vector3* positions = (Vector3*)obj->positions;
-    for (size_t i = 0; i < vc; i++)
+    fastObjMesh* obj = fast_obj_read(path);
+    if (obj == nullptr)
     {
-        fastObjUInt idx_v = obj->indices[i].p;
-        Vector3 v = positions[idx_v];
-        mesh->positions[i] = v;
+        printf("Warning: failed to load obj %s\n", path);
+        return;
     }
 
+    static_assert(sizeof(fastObjIndex) == sizeof(ObjIndex), "fast_obj indices must match ObjIndex");
+    ObjView view;
+    view.positions = reinterpret_cast<const Vector3*>(obj->positions);
+    view.tcoords = reinterpret_cast<const Vector2*>(obj->texcoords);
+    view.normals = reinterpret_cast<const Vector3*>(obj->normals);
+    view.position_count = obj->position_count;
+    view.tcoord_count = obj->texcoord_count;
+    view.normal_count = obj->normal_count;
+    view.indices = reinterpret_cast<const ObjIndex*>(obj->indices);
+    view.face_vertices = obj->face_vertices;
+    view.index_count = obj->index_count;
+    view.face_count = obj->face_count;
+    ImportMeshObj(mesh, view, path);
+
 	fast_obj_destroy(obj);
-    LoadMeshGPU(mesh);
+    LoadMeshObjGPU(mesh, path);
+}
+
+void LoadMeshObjParallel(Mesh* mesh, const char* path)
+{
+    if (LoadMeshCacheGPU(mesh, path))
+        return;
+
+    ObjMesh obj;
+    if (!ParseObjParallel(&obj, path))
+    {
+        printf("Warning: failed to load obj %s\n", path);
+        return;
+    }
+
+    ObjView view;
+    view.positions = obj.positions.data();
+    view.tcoords = obj.tcoords.data();
+    view.normals = obj.normals.data();
+    view.position_count = obj.positions.size();
+    view.tcoord_count = obj.tcoords.size();
+    view.normal_count = obj.normals.size();
+    view.indices = obj.indices.data();
+    view.face_vertices = obj.face_vertices.data();
+    view.index_count = obj.indices.size();
+    view.face_count = obj.face_vertices.size();
+    ImportMeshObj(mesh, view, path);
+
+    LoadMeshObjGPU(mesh, path);
+}
+
+// Import pipeline shared by both obj loaders, LoadMeshObjGPU caches the result so it only runs the first time a file is loaded
+void ImportMeshObj(Mesh* mesh, const ObjView& obj, const char* path)
+{
+    WeldMeshObj(mesh, obj);
+    printf("Welded %s: %zu -> %zu vertices\n", path, obj.index_count, mesh->positions.size());
+    OptimizeMesh(mesh);
+    GenerateMeshLods(mesh);
 }
 
 void UnloadMesh(Mesh* mesh)
 {
-    DestroyVertexArray(&mesh->vao);
-    DestroyBuffer(&mesh->pbo);
-    DestroyBuffer(&mesh->tbo);
-    DestroyBuffer(&mesh->nbo);
-    DestroyBuffer(&mesh->ibo);
+    FreeMeshArenaSpace(mesh);
+    mesh->vao = GL_NONE;
+    mesh->base_vertex = 0;
+    mesh->index_offset = -1;
 
     mesh->positions.resize(0);
     mesh->tcoords.resize(0);
     mesh->normals.resize(0);
     mesh->indices.resize(0);
+    mesh->lods.resize(0);
+    mesh->lod_indices.resize(0);
+    mesh->bvh = MeshBvh();
 
     mesh->vertex_count = -1;
 }
@@ -129,86 +211,496 @@ void LoadMeshIcosahedron(Mesh* mesh)
 }
 
 void DrawMesh(const Mesh& mesh)
+{
+    DrawMeshLod(mesh, 0);
+}
+
+void DrawMeshLod(const Mesh& mesh, int lod)
 {
     BindVertexArray(mesh.vao);
-    if (mesh.ibo != GL_NONE)
-        glDrawElements(GL_TRIANGLES, mesh.vertex_count, GL_UNSIGNED_SHORT, nullptr);
+    DrawMeshBound(mesh, lod);
+    UnbindVertexArray(mesh.vao);
+}
+
+// Byte offset of lod's first index within the arena and its index count
+static size_t MeshLodRange(const Mesh& mesh, int lod, int* count)
+{
+    int first = 0;
+    *count = mesh.vertex_count;
+    if (!mesh.lods.empty())
+    {
+        assert(lod >= 0 && lod < (int)mesh.lods.size());
+        first = mesh.lods[lod].index_offset;
+        *count = mesh.lods[lod].index_count;
+    }
+    return mesh.index_offset + first * IndexTypeSize(mesh.index_type);
+}
+
+void DrawMeshBound(const Mesh& mesh, int lod)
+{
+    if (mesh.index_offset < 0)
+    {
+        glDrawArrays(GL_TRIANGLES, mesh.base_vertex, mesh.vertex_count);
+        return;
+    }
+
+    int count;
+    size_t offset = MeshLodRange(mesh, lod, &count);
+    glDrawElementsBaseVertex(GL_TRIANGLES, count, mesh.index_type, (void*)offset, mesh.base_vertex);
+}
+
+// Instance transforms take 4 attribute locations (one per matrix column) starting here
+#define MESH_INSTANCE_LOCATION 4
+
+// Vertex buffer binding point instance transforms are read from with direct state access (vertices use 0)
+#define MESH_INSTANCE_BINDING 1
+
+// Room for 16k instances per frame (the asteroid field) before the stream has to grow
+#define MESH_INSTANCE_STREAM_SIZE (16384 * sizeof(float16))
+
+static StreamBuffer f_instance_stream;
+
+void DrawMeshInstanced(const Mesh& mesh, const Matrix* transforms, int count, int lod)
+{
+    if (count <= 0)
+        return;
+
+    if (f_instance_stream.buffer == GL_NONE)
+        CreateStreamBuffer(&f_instance_stream, MESH_INSTANCE_STREAM_SIZE);
+
+    // raymath matrices are stored row by row, GL wants columns
+    StreamAllocation instances;
+    AllocateStream(&f_instance_stream, count * sizeof(float16), sizeof(Vector4), &instances);
+    float16* instance_transforms = (float16*)instances.data;
+    for (int i = 0; i < count; i++)
+        instance_transforms[i] = MatrixToFloatV(transforms[i]);
+    FinishStreamAllocation(&f_instance_stream, &instances);
+
+    BindVertexArray(mesh.vao);
+    if (HasDirectStateAccess())
+    {
+        // The format was set up with the vertex array (FormatMeshVertexArray), only the buffer range changes
+        SetVertexArrayBuffer(mesh.vao, MESH_INSTANCE_BINDING, instances.buffer, instances.offset, sizeof(float16));
+        for (int column = 0; column < 4; column++)
+            EnableVertexArrayAttribute(mesh.vao, MESH_INSTANCE_LOCATION + column);
+    }
+    else
+    {
+        BindVertexBuffer(instances.buffer);
+        for (int column = 0; column < 4; column++)
+        {
+            EnableVertexAttribute(MESH_INSTANCE_LOCATION + column);
+            SetVertexAttribute(MESH_INSTANCE_LOCATION + column, 4, GL_FLOAT, sizeof(float16), instances.offset + column * sizeof(Vector4));
+            SetVertexAttributeDivisor(MESH_INSTANCE_LOCATION + column, 1);
+        }
+        UnbindVertexBuffer(instances.buffer);
+    }
+
+    if (mesh.index_offset < 0)
+    {
+        glDrawArraysInstanced(GL_TRIANGLES, mesh.base_vertex, mesh.vertex_count, count);
+    }
     else
-        glDrawArrays(GL_TRIANGLES, 0, mesh.vertex_count);
+    {
+        int index_count;
+        size_t offset = MeshLodRange(mesh, lod, &index_count);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, index_count, mesh.index_type, (void*)offset, count, mesh.base_vertex);
+    }
+
     UnbindVertexArray(mesh.vao);
 }
 
-void LoadMeshGPU(Mesh* mesh)
+int SelectMeshLod(const Mesh& mesh, float distance, float fov_y, float viewport_height, float pixel_error)
 {
-    assert(!mesh->positions.empty());
-    mesh->pbo = CreateBuffer();
-    BindVertexBuffer(mesh->pbo);
-    UpdateVertexBuffer(mesh->positions.data(), mesh->positions.size() * sizeof(Vector3));
-    UnbindVertexBuffer(mesh->pbo);
+    // Pixels per object-space unit at the given distance
+    float pixels_per_unit = viewport_height / (2.0f * tanf(fov_y * 0.5f) * fmaxf(distance, 0.0001f));
 
+    int lod = 0;
+    for (int i = 1; i < (int)mesh.lods.size(); i++)
+    {
+        if (mesh.lods[i].error * pixels_per_unit > pixel_error)
+            break;
+        lod = i;
+    }
+    return lod;
+}
+
+static uint16_t QuantizeUnorm16(float value)
+{
+    return (uint16_t)(fminf(fmaxf(value, 0.0f), 1.0f) * 65535.0f + 0.5f);
+}
+
+static int16_t QuantizeSnorm16(float value)
+{
+    return (int16_t)roundf(fminf(fmaxf(value, -1.0f), 1.0f) * 32767.0f);
+}
+
+// Projects the unit sphere onto an octahedron and unfolds it into [-1, 1]^2
+static Vector2 OctahedralEncode(Vector3 n)
+{
+    // Degenerate triangles can leave zero normals, which get +z rather than NaNs
+    float length = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (length <= EPSILON)
+        return Vector2Zeros;
+
+    n /= length;
+    Vector2 e = { n.x, n.y };
+    if (n.z < 0.0f)
+    {
+        e.x = (1.0f - fabsf(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - fabsf(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
+
+// Scale of 1 for flat axes so we never divide by 0
+static float QuantizationScale(float min, float max)
+{
+    return max > min ? max - min : 1.0f;
+}
+
+// Vertices are interleaved so one fetch brings in every attribute of a vertex
+struct MeshVertex
+{
+    Vector3 position;
+    Vector2 tcoord;
+    Vector3 normal;
+};
+
+struct MeshVertexQuantized
+{
+    Unorm16x4 position;     // w pads positions to 8 bytes so the other attributes stay aligned
+    Unorm16x2 tcoord;
+    Snorm16x2 normal;
+};
+
+typedef VertexLayout<Vector3, Vector2, Vector3> MeshVertexLayout;
+typedef VertexLayout<Unorm16x4, Unorm16x2, Snorm16x2> MeshVertexQuantizedLayout;
+static_assert(sizeof(MeshVertex) == MeshVertexLayout::stride, "MeshVertex must match its layout");
+static_assert(sizeof(MeshVertexQuantized) == MeshVertexQuantizedLayout::stride, "MeshVertexQuantized must match its layout");
+
+// One arena per vertex format, created on first use. Slabs of 256k vertices & 4MB of indices
+// fit every mesh we load, so meshes of a format end up sharing one vertex array.
+#define MESH_ARENA_VERTICES (256 * 1024)
+#define MESH_ARENA_INDEX_BYTES (4 * 1024 * 1024)
+
+static GeometryArena f_arena;
+static GeometryArena f_arena_quantized;
+
+// Direct state access vertex arrays get the instance transform format up front (left disabled until there's a buffer
+// to read), DrawMeshInstanced just points binding 1 at this frame's transforms
+template <typename Layout>
+static void FormatMeshVertexArray(GLuint vao)
+{
+    Layout::SetFormat(vao);
+    for (int column = 0; column < 4; column++)
+        SetVertexArrayAttribute(vao, MESH_INSTANCE_LOCATION + column, 4, GL_FLOAT, column * sizeof(Vector4), false, MESH_INSTANCE_BINDING);
+    SetVertexArrayDivisor(vao, MESH_INSTANCE_BINDING, 1);
+}
+
+template <typename Layout>
+static GeometryArena* MeshArena(GeometryArena* arena)
+{
+    if (arena->set_layout == nullptr)
+    {
+        CreateGeometryArena(arena, Layout::stride, Layout::Set, FormatMeshVertexArray<Layout>,
+            MESH_ARENA_VERTICES, MESH_ARENA_INDEX_BYTES);
+    }
+    return arena;
+}
+
+static GeometryArena* MeshArena(const Mesh& mesh)
+{
+    return mesh.quantized ? MeshArena<MeshVertexQuantizedLayout>(&f_arena_quantized) : MeshArena<MeshVertexLayout>(&f_arena);
+}
+
+// Backing memory for the streams of a freshly imported mesh, freed once they're uploaded & cached
+struct MeshStreamData
+{
+    std::vector<uint8_t> vertices;
+    std::vector<uint8_t> indices;
+};
+
+template <typename Vertex>
+static Vertex* ResizeVertices(std::vector<uint8_t>* data, size_t count)
+{
+    // Value-initialized bytes, so attributes the mesh doesn't have stay zeroed
+    data->assign(count * sizeof(Vertex), 0);
+    return reinterpret_cast<Vertex*>(data->data());
+}
+
+static void FreeMeshArenaSpace(Mesh* mesh)
+{
+    if (mesh->vertex_allocation.block < 0)
+        return;
+
+    GeometryArena* arena = MeshArena(*mesh);
+    FreeArenaVertices(arena, &mesh->vertex_allocation);
+    FreeArenaIndices(arena, &mesh->index_allocation);
+}
+
+void UpdateMeshBuffers()
+{
+    if (f_arena.set_layout != nullptr)
+        UpdateGeometryArena(&f_arena);
+    if (f_arena_quantized.set_layout != nullptr)
+        UpdateGeometryArena(&f_arena_quantized);
+    if (f_instance_stream.buffer != GL_NONE)
+        AdvanceStreamBuffer(&f_instance_stream);
+}
+
+void GetMeshArenaStats(bool quantized, BufferPoolStats* vertices, BufferPoolStats* indices)
+{
+    const GeometryArena& arena = quantized ? f_arena_quantized : f_arena;
+    *vertices = GetBufferPoolStats(arena.vertices);
+    *indices = GetBufferPoolStats(arena.indices);
+}
+
+void UnloadMeshBuffers()
+{
+    DestroyGeometryArena(&f_arena);
+    DestroyGeometryArena(&f_arena_quantized);
+    DestroyStreamBuffer(&f_instance_stream);
+}
+
+// Missing tcoords or normals are left zeroed so the layout stays the same for every mesh
+static void BuildQuantizedVertices(Mesh* mesh, std::vector<uint8_t>* data)
+{
+    MeshQuantization& q = mesh->quantization;
+    q = MeshQuantization();
+    q.position_offset = mesh->bounds_min;
+    q.position_scale =
+    {
+        QuantizationScale(mesh->bounds_min.x, mesh->bounds_max.x),
+        QuantizationScale(mesh->bounds_min.y, mesh->bounds_max.y),
+        QuantizationScale(mesh->bounds_min.z, mesh->bounds_max.z)
+    };
+
+    // Tiling uvs go past [0, 1] so tcoords get the same treatment as positions
     if (!mesh->tcoords.empty())
     {
-        mesh->tbo = CreateBuffer();
-        BindVertexBuffer(mesh->tbo);
-        UpdateVertexBuffer(mesh->tcoords.data(), mesh->tcoords.size() * sizeof(Vector2));
-        UnbindVertexBuffer(mesh->tbo);
+        Vector2 tcoord_min = mesh->tcoords[0];
+        Vector2 tcoord_max = mesh->tcoords[0];
+        for (Vector2 tcoord : mesh->tcoords)
+        {
+            tcoord_min = Vector2Min(tcoord_min, tcoord);
+            tcoord_max = Vector2Max(tcoord_max, tcoord);
+        }
+
+        q.tcoord_offset = tcoord_min;
+        q.tcoord_scale = { QuantizationScale(tcoord_min.x, tcoord_max.x), QuantizationScale(tcoord_min.y, tcoord_max.y) };
     }
-    else
-        printf("Warning: mesh loaded without texture coordinates\n");
 
-    if (!mesh->normals.empty())
+    MeshVertexQuantized* vertices = ResizeVertices<MeshVertexQuantized>(data, mesh->positions.size());
+    for (size_t i = 0; i < mesh->positions.size(); i++)
     {
-        mesh->nbo = CreateBuffer();
-        BindVertexBuffer(mesh->nbo);
-        UpdateVertexBuffer(mesh->normals.data(), mesh->normals.size() * sizeof(Vector3));
-        UnbindVertexBuffer(mesh->nbo);
+        MeshVertexQuantized& vertex = vertices[i];
+        Vector3 p = (mesh->positions[i] - q.position_offset) / q.position_scale;
+        vertex.position = { QuantizeUnorm16(p.x), QuantizeUnorm16(p.y), QuantizeUnorm16(p.z), 0 };
+
+        if (!mesh->tcoords.empty())
+        {
+            Vector2 t = (mesh->tcoords[i] - q.tcoord_offset) / q.tcoord_scale;
+            vertex.tcoord = { QuantizeUnorm16(t.x), QuantizeUnorm16(t.y) };
+        }
+
+        if (!mesh->normals.empty())
+        {
+            Vector2 e = OctahedralEncode(mesh->normals[i]);
+            vertex.normal = { QuantizeSnorm16(e.x), QuantizeSnorm16(e.y) };
+        }
     }
+}
+
+static void BuildFloatVertices(Mesh* mesh, std::vector<uint8_t>* data)
+{
+    mesh->quantization = MeshQuantization();
+
+    MeshVertex* vertices = ResizeVertices<MeshVertex>(data, mesh->positions.size());
+    for (size_t i = 0; i < mesh->positions.size(); i++)
+    {
+        vertices[i].position = mesh->positions[i];
+        if (!mesh->tcoords.empty())
+            vertices[i].tcoord = mesh->tcoords[i];
+        if (!mesh->normals.empty())
+            vertices[i].normal = mesh->normals[i];
+    }
+}
+
+// Levels of detail follow the full-detail indices.
+// Use 16-bit indices whenever possible since they halve index fetch bandwidth.
+// Indices are relative to the mesh's base vertex, so this only depends on the mesh's own size.
+template <typename Index>
+static void BuildIndices(const Mesh& mesh, std::vector<uint8_t>* data)
+{
+    data->resize((mesh.indices.size() + mesh.lod_indices.size()) * sizeof(Index));
+    Index* indices = reinterpret_cast<Index*>(data->data());
+    indices = std::copy(mesh.indices.begin(), mesh.indices.end(), indices);
+    std::copy(mesh.lod_indices.begin(), mesh.lod_indices.end(), indices);
+}
+
+static MeshStreams BuildMeshStreams(Mesh* mesh, MeshStreamData* data)
+{
+    MeshStreams streams;
+    if (mesh->quantized)
+        BuildQuantizedVertices(mesh, &data->vertices);
     else
-        printf("Warning: mesh loaded without normals\n");
+        BuildFloatVertices(mesh, &data->vertices);
+    streams.vertices = data->vertices.data();
+    streams.vertex_count = (int)mesh->positions.size();
+    streams.vertex_stride = mesh->quantized ? sizeof(MeshVertexQuantized) : sizeof(MeshVertex);
+
+    streams.index_type = mesh->positions.size() <= UINT16_MAX + 1 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    if (streams.index_type == GL_UNSIGNED_SHORT)
+        BuildIndices<uint16_t>(*mesh, &data->indices);
+    else
+        BuildIndices<uint32_t>(*mesh, &data->indices);
+    streams.indices = data->indices.data();
+    streams.index_count = (int)(mesh->indices.size() + mesh->lod_indices.size());
+    return streams;
+}
+
+static void UploadMeshStreams(Mesh* mesh, const MeshStreams& streams)
+{
+    GeometryArena* arena = MeshArena(*mesh);
+    assert(arena->vertex_stride == streams.vertex_stride);
+    mesh->base_vertex = AllocateArenaVertices(arena, streams.vertices, streams.vertex_count, &mesh->vertex_allocation);
 
-    if (!mesh->indices.empty())
+    if (streams.index_count > 0)
     {
-        mesh->ibo = CreateBuffer();
-        BindIndexBuffer(mesh->ibo);
-            UpdateElementBuffer(mesh->indices.data(), mesh->indices.size() * sizeof(uint16_t));
-        UnbindIndexBuffer(mesh->ibo);
+        mesh->index_type = streams.index_type;
+        mesh->index_offset = AllocateArenaIndices(arena, streams.indices, streams.index_count, streams.index_type, &mesh->index_allocation);
+        mesh->vao = ArenaVertexArray(arena, mesh->vertex_allocation, &mesh->index_allocation);
     }
     else
+    {
         printf("Warning: mesh loaded without index buffer\n");
+        mesh->vao = ArenaVertexArray(arena, mesh->vertex_allocation, nullptr);
+    }
+}
 
-    mesh->vao = CreateVertexArray();
-    BindVertexArray(mesh->vao);
+static void ComputeMeshBounds(Mesh* mesh)
+{
+    mesh->bounds_min = mesh->positions[0];
+    mesh->bounds_max = mesh->positions[0];
+    for (Vector3 position : mesh->positions)
+    {
+        mesh->bounds_min = Vector3Min(mesh->bounds_min, position);
+        mesh->bounds_max = Vector3Max(mesh->bounds_max, position);
+    }
 
-    if (mesh->ibo != GL_NONE)
-        BindIndexBuffer(mesh->ibo);
+    // Centering the sphere on the box is a few percent looser than optimal but costs one more pass
+    mesh->sphere_center = (mesh->bounds_min + mesh->bounds_max) * 0.5f;
+    float radius_sqr = 0.0f;
+    for (Vector3 position : mesh->positions)
+        radius_sqr = fmaxf(radius_sqr, Vector3DistanceSqr(position, mesh->sphere_center));
+    mesh->sphere_radius = sqrtf(radius_sqr);
+}
 
-    EnableVertexAttribute(0);
-    EnableVertexAttribute(1);
-    EnableVertexAttribute(2);
+bool RaycastMesh(const Mesh& mesh, Vector3 origin, Vector3 direction, RayHit* hit)
+{
+    return RaycastBvh(mesh.bvh, mesh.indices, mesh.positions, origin, direction, hit);
+}
+
+bool MeshInFrustum(const Mesh& mesh, Matrix world, const Frustum& frustum)
+{
+    // Cheap sphere test first. Its radius grows with the largest axis scale of world.
+    Vector3 center = Vector3Transform(mesh.sphere_center, world);
+    float scale_sqr = fmaxf(fmaxf(
+        Vector3LengthSqr({ world.m0, world.m1, world.m2 }),
+        Vector3LengthSqr({ world.m4, world.m5, world.m6 })),
+        Vector3LengthSqr({ world.m8, world.m9, world.m10 }));
+    if (!SphereInFrustum(frustum, center, mesh.sphere_radius * sqrtf(scale_sqr)))
+        return false;
+
+    // Then the world-space box around the transformed object-space box
+    Vector3 box_center = Vector3Transform((mesh.bounds_min + mesh.bounds_max) * 0.5f, world);
+    Vector3 extents = (mesh.bounds_max - mesh.bounds_min) * 0.5f;
+    Vector3 box_extents =
+    {
+        fabsf(world.m0) * extents.x + fabsf(world.m4) * extents.y + fabsf(world.m8) * extents.z,
+        fabsf(world.m1) * extents.x + fabsf(world.m5) * extents.y + fabsf(world.m9) * extents.z,
+        fabsf(world.m2) * extents.x + fabsf(world.m6) * extents.y + fabsf(world.m10) * extents.z
+    };
+    return BoxInFrustum(frustum, box_center - box_extents, box_center + box_extents);
+}
 
-    assert(mesh->pbo != GL_NONE);
-    BindVertexBuffer(mesh->pbo);
-    SetVertexAttribute(0, 3, GL_FLOAT, sizeof(Vector3));
-    UnbindVertexBuffer(mesh->pbo);
+static const Uniform<Vector3> u_position_offset = RegisterUniform<Vector3>("u_position_offset");
+static const Uniform<Vector3> u_position_scale = RegisterUniform<Vector3>("u_position_scale");
+static const Uniform<Vector2> u_tcoord_offset = RegisterUniform<Vector2>("u_tcoord_offset");
+static const Uniform<Vector2> u_tcoord_scale = RegisterUniform<Vector2>("u_tcoord_scale");
+static const Uniform<int> u_octahedral_normals = RegisterUniform<int>("u_octahedral_normals");
 
-    if (mesh->tbo != GL_NONE)
+void SendMeshQuantization(const Mesh& mesh)
+{
+    // Each shader only decodes the attributes it reads
+    if (HasUniform(u_position_offset))
     {
-        BindVertexBuffer(mesh->tbo);
-        SetVertexAttribute(1, 2, GL_FLOAT, sizeof(Vector2));
-        UnbindVertexBuffer(mesh->tbo);
+        SetUniform(u_position_offset, mesh.quantization.position_offset);
+        SetUniform(u_position_scale, mesh.quantization.position_scale);
     }
-    
-    if (mesh->nbo != GL_NONE)
+
+    if (HasUniform(u_tcoord_offset))
     {
-        BindVertexBuffer(mesh->nbo);
-        SetVertexAttribute(2, 3, GL_FLOAT, sizeof(Vector3));
-        UnbindVertexBuffer(mesh->nbo);
+        SetUniform(u_tcoord_offset, mesh.quantization.tcoord_offset);
+        SetUniform(u_tcoord_scale, mesh.quantization.tcoord_scale);
     }
 
-    UnbindVertexArray(mesh->vao);
+    if (HasUniform(u_octahedral_normals))
+        SetUniform(u_octahedral_normals, mesh.quantized ? 1 : 0);
+}
+
+// Every loader ends up here, so this is where the CPU-side acceleration structures get built too
+static void LoadMeshCPU(Mesh* mesh)
+{
+    ComputeMeshBounds(mesh);
+    BuildMeshBvh(&mesh->bvh, mesh->indices, mesh->positions);
+}
+
+static MeshStreams LoadMeshGPU(Mesh* mesh, MeshStreamData* data)
+{
+    assert(!mesh->positions.empty());
+    if (mesh->tcoords.empty())
+        printf("Warning: mesh loaded without texture coordinates\n");
+    if (mesh->normals.empty())
+        printf("Warning: mesh loaded without normals\n");
+
+    LoadMeshCPU(mesh);
+    MeshStreams streams = BuildMeshStreams(mesh, data);
+    UploadMeshStreams(mesh, streams);
+    return streams;
+}
+
+void LoadMeshGPU(Mesh* mesh)
+{
+    MeshStreamData data;
+    LoadMeshGPU(mesh, &data);
+}
+
+// Cache hits go from the mapped file to the GPU without an intermediate copy
+static bool LoadMeshCacheGPU(Mesh* mesh, const char* path)
+{
+    MeshCacheView cache;
+    if (!MapMeshCache(&cache, mesh, path, MeshArena(*mesh)->vertex_stride))
+        return false;
+
+    LoadMeshCPU(mesh);
+    UploadMeshStreams(mesh, cache.streams);
+    UnmapMeshCache(&cache);
+    return true;
+}
+
+// Caches the streams of a freshly imported obj, then drops the attributes only they needed.
+// That leaves the mesh the same whether it came from the obj or the cache.
+static void LoadMeshObjGPU(Mesh* mesh, const char* path)
+{
+    MeshStreamData data;
+    MeshStreams streams = LoadMeshGPU(mesh, &data);
+    SaveMeshCache(*mesh, streams, path);
 
-    if (mesh->ibo != GL_NONE)
-        UnbindIndexBuffer(mesh->ibo);
+    std::vector<Vector2>().swap(mesh->tcoords);
+    std::vector<Vector3>().swap(mesh->normals);
+    std::vector<uint32_t>().swap(mesh->lod_indices);
 }
 
 void LoadMeshPar(Mesh* mesh, par_shapes_mesh* par)
@@ -229,9 +721,12 @@ void LoadMeshPar(Mesh* mesh, par_shapes_mesh* par)
     Vector2* par_tcoords = reinterpret_cast<Vector2*>(par->tcoords);
     memcpy(mesh->positions.data(), par_positions, par->npoints * sizeof(Vector3));
     memcpy(mesh->normals.data(), par_normals, par->npoints * sizeof(Vector3));
-    memcpy(mesh->indices.data(), par->triangles, mesh->vertex_count * sizeof(PAR_SHAPES_T));
+    for (int i = 0; i < mesh->vertex_count; i++)
+        mesh->indices[i] = par->triangles[i];
     if (par_tcoords != nullptr)
         memcpy(mesh->tcoords.data(), par_tcoords, par->npoints * sizeof(Vector2));
+
+    OptimizeMesh(mesh);
 }
 
 void LoadMeshPlaneOptimal(Mesh* mesh)
@@ -317,3 +812,86 @@ void LoadMeshPlaneUnoptimal(Mesh* mesh)
         mesh->normals[i] = vn;
     }
 }
+
+// An obj face-corner references positions, tcoords & normals separately, so a unique vertex is a unique index triple
+struct ObjVertexKey
+{
+    uint32_t p, t, n;
+
+    bool operator==(const ObjVertexKey& other) const
+    {
+        return p == other.p && t == other.t && n == other.n;
+    }
+};
+
+struct ObjVertexKeyHash
+{
+    size_t operator()(const ObjVertexKey& key) const
+    {
+        uint64_t hash = key.p * 0x9E3779B97F4A7C15ull;
+        hash ^= key.t * 0xC2B2AE3D27D4EB4Full + (hash << 6) + (hash >> 2);
+        hash ^= key.n * 0x165667B19E3779F9ull + (hash << 6) + (hash >> 2);
+        return (size_t)hash;
+    }
+};
+
+void WeldMeshObj(Mesh* mesh, const ObjView& obj)
+{
+    // Index 0 of each attribute array is a dummy entry, so count > 1 means the file has that attribute
+    bool has_tcoords = obj.tcoord_count > 1;
+    bool has_normals = obj.normal_count > 1;
+
+    const Vector3* positions = obj.positions;
+    const Vector2* tcoords = obj.tcoords;
+    const Vector3* normals = obj.normals;
+
+    std::unordered_map<ObjVertexKey, uint32_t, ObjVertexKeyHash> unique;
+    unique.reserve(obj.index_count);
+
+    mesh->positions.clear();
+    mesh->tcoords.clear();
+    mesh->normals.clear();
+    mesh->indices.clear();
+    mesh->positions.reserve(obj.index_count);
+    mesh->indices.reserve(obj.index_count);
+    if (has_tcoords)
+        mesh->tcoords.reserve(obj.index_count);
+    if (has_normals)
+        mesh->normals.reserve(obj.index_count);
+
+    // Faces may be polygons, so fan-triangulate them as we emit indices
+    std::vector<uint32_t> face;
+    size_t corner = 0;
+    for (size_t f = 0; f < obj.face_count; f++)
+    {
+        uint32_t face_vertex_count = obj.face_vertices[f];
+        face.resize(face_vertex_count);
+        for (uint32_t i = 0; i < face_vertex_count; i++)
+        {
+            ObjIndex index = obj.indices[corner++];
+            ObjVertexKey key{ index.p, index.t, index.n };
+            auto it = unique.find(key);
+            if (it == unique.end())
+            {
+                uint32_t vertex = (uint32_t)mesh->positions.size();
+                it = unique.emplace(key, vertex).first;
+
+                mesh->positions.push_back(positions[index.p]);
+                if (has_tcoords)
+                    mesh->tcoords.push_back(tcoords[index.t]);
+                if (has_normals)
+                    mesh->normals.push_back(normals[index.n]);
+            }
+            face[i] = it->second;
+        }
+
+        for (uint32_t i = 2; i < face_vertex_count; i++)
+        {
+            mesh->indices.push_back(face[0]);
+            mesh->indices.push_back(face[i - 1]);
+            mesh->indices.push_back(face[i]);
+        }
+    }
+
+    mesh->vertex_count = (int)mesh->indices.size();
+}
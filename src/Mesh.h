@@ -3,24 +3,66 @@
 #include <glad/glad.h>
 #include <vector>
 #include "raymath.h"
+#include "Buffer.h"
+#include "Frustum.h"
+#include "MeshBvh.h"
+
+#define MESH_LOD_MAX 5
+
+// A level of detail is a range of the mesh's index buffer that reuses the mesh's vertices
+struct MeshLod
+{
+	int index_offset = 0;	// First index of this level relative to the mesh's first index
+	int index_count = 0;
+	float error = 0.0f;		// Object-space distance the simplified surface deviates from LOD 0
+};
+
+// Maps a quantized mesh's unorm16 positions & tcoords back to object space (offset + value * scale).
+// Identity for float meshes so shaders can dequantize unconditionally.
+struct MeshQuantization
+{
+	Vector3 position_offset = Vector3Zeros;
+	Vector3 position_scale = Vector3Ones;
+	Vector2 tcoord_offset = Vector2Zeros;
+	Vector2 tcoord_scale = Vector2Ones;
+};
 
 // Extra practice 2:
 // Have a look at the fastObjMesh data-type.
 // See if you can transform the data loaded into fastObjMesh to the data the GPU expects!
 struct Mesh
 {
+	// Obj meshes only keep what the CPU still reads after upload (positions & indices for the bvh, lods),
+	// tcoords, normals & lod_indices are released once the mesh is cached
 	std::vector<Vector3> positions;
 	std::vector<Vector2> tcoords;
 	std::vector<Vector3> normals;
-	std::vector<uint16_t> indices;
+	std::vector<uint32_t> indices;	// CPU-side indices are always 32-bit, narrowed to index_type on upload
 
-	GLuint pbo = GL_NONE;	// positions buffer
-	GLuint tbo = GL_NONE;	// tcoords buffer
-	GLuint nbo = GL_NONE;	// normals buffer
-	GLuint ibo = GL_NONE;	// index buffer
+	std::vector<MeshLod> lods;				// Empty if the mesh has no levels of detail, otherwise lods[0] is the full mesh
+	std::vector<uint32_t> lod_indices;		// Indices of lods 1+, uploaded right after indices
 
-	GLuint vao = GL_NONE;
+	// Vertices & indices live in the geometry arena of the mesh's vertex format (MeshVertex or MeshVertexQuantized)
+	GLuint vao = GL_NONE;	// the arena's vertex array for the mesh's slabs, shared with every other mesh in them
+	int base_vertex = 0;	// added to each index, the mesh's first vertex within its vertex slab
+	int index_offset = -1;	// byte offset of the mesh's first index within its index slab, -1 if the mesh isn't indexed
+	BufferAllocation vertex_allocation;	// The mesh's share of the arena, returned by UnloadMesh
+	BufferAllocation index_allocation;
+	GLenum index_type = GL_UNSIGNED_SHORT;	// GL_UNSIGNED_SHORT when every index fits in 16 bits, otherwise GL_UNSIGNED_INT
 	int vertex_count = -1;
+
+	// Object-space bounding volumes, computed on load
+	Vector3 bounds_min = Vector3Zeros;
+	Vector3 bounds_max = Vector3Zeros;
+	Vector3 sphere_center = Vector3Zeros;
+	float sphere_radius = 0.0f;
+
+	MeshBvh bvh;	// Over the full-detail triangles, for ray queries
+
+	// Set before loading to upload 16 bytes per vertex (MeshVertexQuantized) instead of 32 (MeshVertex):
+	// unorm16 positions & tcoords against their bounds and octahedral snorm16 normals
+	bool quantized = false;
+	MeshQuantization quantization;
 };
 
 void UnloadMesh(Mesh* mesh);
@@ -36,5 +78,36 @@ void LoadMeshSphere(Mesh* mesh);
 void LoadMeshHemisphere(Mesh* mesh);
 
 void LoadMeshObj(Mesh* mesh, const char* path);
+void LoadMeshObjParallel(Mesh* mesh, const char* path);	// Multithreaded obj parser for large files, same result as LoadMeshObj
+
+// Sends the current shader what it needs to decode mesh's vertices (u_position_offset/scale, u_tcoord_offset/scale & u_octahedral_normals)
+void SendMeshQuantization(const Mesh& mesh);
+
+// Closest full-detail triangle hit by an object-space ray (see RaycastBvh)
+bool RaycastMesh(const Mesh& mesh, Vector3 origin, Vector3 direction, RayHit* hit);
+
+// True if mesh placed with world is at least partially inside frustum (world-space planes)
+bool MeshInFrustum(const Mesh& mesh, Matrix world, const Frustum& frustum);
+
+// Destroys the buffers every mesh shares (geometry arenas & instance stream), call after unloading every mesh
+void UnloadMeshBuffers();
+
+// Call once per frame after drawing: recycles space from unloaded meshes and moves the instance stream on to its next region
+void UpdateMeshBuffers();
+
+// Memory use of the arena for quantized or float meshes
+void GetMeshArenaStats(bool quantized, BufferPoolStats* vertices, BufferPoolStats* indices);
+
+void DrawMesh(const Mesh& mesh);
+void DrawMeshLod(const Mesh& mesh, int lod);
+
+// Same as DrawMeshLod without binding mesh.vao. Meshes of a vertex format share theirs,
+// so bind it once (BindVertexArray) and draw them all with this to skip the per-draw binds.
+void DrawMeshBound(const Mesh& mesh, int lod = 0);
+
+// Draws count copies of mesh in one call. transforms are world matrices written to a stream buffer and read as
+// instanced attributes (locations 4-7), so use an _instanced shader, which takes u_view_proj instead of u_mvp.
+void DrawMeshInstanced(const Mesh& mesh, const Matrix* transforms, int count, int lod = 0);
 
-void DrawMesh(const Mesh& mesh);
\ No newline at end of file
+// Picks the coarsest level whose error projects to at most pixel_error pixels at distance from the camera
+int SelectMeshLod(const Mesh& mesh, float distance, float fov_y, float viewport_height, float pixel_error = 1.0f);
\ No newline at end of file
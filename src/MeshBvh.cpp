@@ -0,0 +1,360 @@
+#include "MeshBvh.h"
+#include "Jobs.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BVH_SSE 1
+#endif
+
+#define BVH_BIN_COUNT 12
+#define BVH_MAX_LEAF_SIZE 8
+#define BVH_PARALLEL_THRESHOLD 4096  // Subtrees smaller than this aren't worth a job
+#define BVH_MAX_DEPTH 64             // Also bounds the traversal stack
+
+struct BvhBuild
+{
+    std::vector<Vector3> triangle_mins;
+    std::vector<Vector3> triangle_maxs;
+    std::vector<Vector3> centroids;
+    MeshBvh* bvh;
+    std::atomic<uint32_t> node_count{ 0 };
+};
+
+struct BvhBin
+{
+    Vector3 min = { FLT_MAX, FLT_MAX, FLT_MAX };
+    Vector3 max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    uint32_t count = 0;
+};
+
+static float SurfaceArea(Vector3 min, Vector3 max)
+{
+    Vector3 e = max - min;
+    return e.x < 0.0f ? 0.0f : 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+// fminf/fmaxf handle NaNs, which the build never sees, and often don't inline
+static Vector3 Min(Vector3 a, Vector3 b)
+{
+    return { a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z };
+}
+
+static Vector3 Max(Vector3 a, Vector3 b)
+{
+    return { a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z };
+}
+
+static float Component(Vector3 v, int axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static void BuildNode(BvhBuild* build, uint32_t node_index, uint32_t first, uint32_t count, int depth)
+{
+    uint32_t* triangles = build->bvh->triangles.data();
+    BvhNode& node = build->bvh->nodes[node_index];
+
+    Vector3 min = { FLT_MAX, FLT_MAX, FLT_MAX };
+    Vector3 max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    Vector3 centroid_min = min;
+    Vector3 centroid_max = max;
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        uint32_t t = triangles[i];
+        min = Min(min, build->triangle_mins[t]);
+        max = Max(max, build->triangle_maxs[t]);
+        centroid_min = Min(centroid_min, build->centroids[t]);
+        centroid_max = Max(centroid_max, build->centroids[t]);
+    }
+
+    node.min = min;
+    node.max = max;
+    node.left_first = first;
+    node.count = count;
+    if (count <= 2 || depth >= BVH_MAX_DEPTH - 1)
+        return;
+
+    // Bin centroids along each axis and sweep for the split with the lowest surface area heuristic cost
+    float best_cost = FLT_MAX;
+    int best_axis = -1;
+    int best_split = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float axis_min = Component(centroid_min, axis);
+        float extent = Component(centroid_max, axis) - axis_min;
+        if (extent <= 0.0f)
+            continue;
+
+        BvhBin bins[BVH_BIN_COUNT];
+        float bin_scale = BVH_BIN_COUNT / extent;
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            uint32_t t = triangles[i];
+            int b = std::min((int)((Component(build->centroids[t], axis) - axis_min) * bin_scale), BVH_BIN_COUNT - 1);
+            bins[b].min = Min(bins[b].min, build->triangle_mins[t]);
+            bins[b].max = Max(bins[b].max, build->triangle_maxs[t]);
+            bins[b].count++;
+        }
+
+        // Cost of splitting after bin i is area(left) * count(left) + area(right) * count(right)
+        float left_costs[BVH_BIN_COUNT - 1];
+        BvhBin left;
+        for (int i = 0; i < BVH_BIN_COUNT - 1; i++)
+        {
+            left.min = Min(left.min, bins[i].min);
+            left.max = Max(left.max, bins[i].max);
+            left.count += bins[i].count;
+            left_costs[i] = SurfaceArea(left.min, left.max) * left.count;
+        }
+
+        BvhBin right;
+        for (int i = BVH_BIN_COUNT - 1; i > 0; i--)
+        {
+            right.min = Min(right.min, bins[i].min);
+            right.max = Max(right.max, bins[i].max);
+            right.count += bins[i].count;
+
+            float cost = left_costs[i - 1] + SurfaceArea(right.min, right.max) * right.count;
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = i;
+            }
+        }
+    }
+
+    // Traversing a node costs about as much as testing one triangle
+    float area = SurfaceArea(min, max);
+    float leaf_cost = area * count;
+    float split_cost = area + best_cost;
+    if (best_axis < 0 || (split_cost >= leaf_cost && count <= BVH_MAX_LEAF_SIZE))
+        return;
+
+    float axis_min = Component(centroid_min, best_axis);
+    float bin_scale = BVH_BIN_COUNT / (Component(centroid_max, best_axis) - axis_min);
+    uint32_t* middle = std::partition(triangles + first, triangles + first + count, [&](uint32_t t)
+    {
+        int b = std::min((int)((Component(build->centroids[t], best_axis) - axis_min) * bin_scale), BVH_BIN_COUNT - 1);
+        return b < best_split;
+    });
+
+    uint32_t left_count = (uint32_t)(middle - (triangles + first));
+    if (left_count == 0 || left_count == count)
+        return;
+
+    uint32_t left_index = build->node_count.fetch_add(2);
+    node.left_first = left_index;
+    node.count = 0;
+
+    // Children cover disjoint ranges of triangles and nodes so they can be built concurrently
+    if (count >= BVH_PARALLEL_THRESHOLD)
+    {
+        ParallelFor(2, [&](int i)
+        {
+            if (i == 0)
+                BuildNode(build, left_index, first, left_count, depth + 1);
+            else
+                BuildNode(build, left_index + 1, first + left_count, count - left_count, depth + 1);
+        });
+    }
+    else
+    {
+        BuildNode(build, left_index, first, left_count, depth + 1);
+        BuildNode(build, left_index + 1, first + left_count, count - left_count, depth + 1);
+    }
+}
+
+void BuildMeshBvh(MeshBvh* bvh, const std::vector<uint32_t>& indices, const std::vector<Vector3>& positions)
+{
+    bvh->nodes.clear();
+    bvh->triangles.clear();
+    uint32_t triangle_count = (uint32_t)(indices.size() / 3);
+    if (triangle_count == 0)
+        return;
+
+    BvhBuild build;
+    build.bvh = bvh;
+    build.triangle_mins.resize(triangle_count);
+    build.triangle_maxs.resize(triangle_count);
+    build.centroids.resize(triangle_count);
+
+    const uint32_t block_size = 4096;
+    ParallelFor((int)((triangle_count + block_size - 1) / block_size), [&](int block)
+    {
+        uint32_t end = std::min((uint32_t)(block + 1) * block_size, triangle_count);
+        for (uint32_t t = block * block_size; t < end; t++)
+        {
+            Vector3 p0 = positions[indices[t * 3 + 0]];
+            Vector3 p1 = positions[indices[t * 3 + 1]];
+            Vector3 p2 = positions[indices[t * 3 + 2]];
+            build.triangle_mins[t] = Min(Min(p0, p1), p2);
+            build.triangle_maxs[t] = Max(Max(p0, p1), p2);
+            build.centroids[t] = (build.triangle_mins[t] + build.triangle_maxs[t]) * 0.5f;
+        }
+    });
+
+    bvh->triangles.resize(triangle_count);
+    for (uint32_t t = 0; t < triangle_count; t++)
+        bvh->triangles[t] = t;
+
+    // A binary tree with a leaf per triangle is as big as it gets
+    bvh->nodes.resize(triangle_count * 2 - 1);
+    build.node_count = 1;
+    BuildNode(&build, 0, 0, triangle_count, 0);
+    bvh->nodes.resize(build.node_count);
+}
+
+// Precomputed per-ray values for the slab tests
+struct BvhRay
+{
+    Vector3 origin;
+    Vector3 inv_direction;
+#if BVH_SSE
+    __m128 origin4;
+    __m128 inv_direction4;
+#endif
+};
+
+// Distance at which the ray enters node's box, or FLT_MAX if it misses (or only enters beyond max_distance)
+static float IntersectNode(const BvhRay& ray, const BvhNode& node, float max_distance)
+{
+#if BVH_SSE
+    // All 3 slabs at once. The 4th lane holds left_first/count so it gets replaced with the ray's [0, max_distance].
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.min.x), ray.origin4), ray.inv_direction4);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.max.x), ray.origin4), ray.inv_direction4);
+    const __m128 xyz_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    __m128 near4 = _mm_or_ps(_mm_and_ps(_mm_min_ps(t0, t1), xyz_mask), _mm_set_ps(0.0f, 0.0f, 0.0f, 0.0f));
+    __m128 far4 = _mm_or_ps(_mm_and_ps(_mm_max_ps(t0, t1), xyz_mask), _mm_set_ps(max_distance, 0.0f, 0.0f, 0.0f));
+
+    near4 = _mm_max_ps(near4, _mm_shuffle_ps(near4, near4, _MM_SHUFFLE(1, 0, 3, 2)));
+    near4 = _mm_max_ps(near4, _mm_shuffle_ps(near4, near4, _MM_SHUFFLE(2, 3, 0, 1)));
+    far4 = _mm_min_ps(far4, _mm_shuffle_ps(far4, far4, _MM_SHUFFLE(1, 0, 3, 2)));
+    far4 = _mm_min_ps(far4, _mm_shuffle_ps(far4, far4, _MM_SHUFFLE(2, 3, 0, 1)));
+    float t_near = _mm_cvtss_f32(near4);
+    float t_far = _mm_cvtss_f32(far4);
+#else
+    Vector3 t0 = (node.min - ray.origin) * ray.inv_direction;
+    Vector3 t1 = (node.max - ray.origin) * ray.inv_direction;
+    Vector3 near3 = Vector3Min(t0, t1);
+    Vector3 far3 = Vector3Max(t0, t1);
+    float t_near = fmaxf(fmaxf(fmaxf(near3.x, near3.y), near3.z), 0.0f);
+    float t_far = fminf(fminf(fminf(far3.x, far3.y), far3.z), max_distance);
+#endif
+    return t_near <= t_far ? t_near : FLT_MAX;
+}
+
+// Moller-Trumbore
+static bool IntersectTriangle(Vector3 origin, Vector3 direction, Vector3 p0, Vector3 p1, Vector3 p2, RayHit* hit)
+{
+    Vector3 e1 = p1 - p0;
+    Vector3 e2 = p2 - p0;
+    Vector3 p = Vector3CrossProduct(direction, e2);
+    float det = Vector3DotProduct(e1, p);
+    if (fabsf(det) < 1e-12f)
+        return false;
+
+    float inv_det = 1.0f / det;
+    Vector3 s = origin - p0;
+    float u = Vector3DotProduct(s, p) * inv_det;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    Vector3 q = Vector3CrossProduct(s, e1);
+    float v = Vector3DotProduct(direction, q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    float t = Vector3DotProduct(e2, q) * inv_det;
+    if (t < 0.0f || t >= hit->distance)
+        return false;
+
+    hit->u = u;
+    hit->v = v;
+    hit->distance = t;
+    return true;
+}
+
+bool RaycastBvh(const MeshBvh& bvh, const std::vector<uint32_t>& indices, const std::vector<Vector3>& positions,
+    Vector3 origin, Vector3 direction, RayHit* hit, float max_distance)
+{
+    *hit = RayHit();
+    hit->distance = max_distance;
+    if (bvh.nodes.empty())
+        return false;
+
+    // Axis-parallel rays get a huge (rather than infinite) inverse so 0 * inverse can't make a NaN
+    BvhRay ray;
+    ray.origin = origin;
+    ray.inv_direction =
+    {
+        fabsf(direction.x) > 1e-30f ? 1.0f / direction.x : copysignf(1e30f, direction.x),
+        fabsf(direction.y) > 1e-30f ? 1.0f / direction.y : copysignf(1e30f, direction.y),
+        fabsf(direction.z) > 1e-30f ? 1.0f / direction.z : copysignf(1e30f, direction.z)
+    };
+#if BVH_SSE
+    ray.origin4 = _mm_set_ps(0.0f, origin.z, origin.y, origin.x);
+    ray.inv_direction4 = _mm_set_ps(0.0f, ray.inv_direction.z, ray.inv_direction.y, ray.inv_direction.x);
+#endif
+
+    if (IntersectNode(ray, bvh.nodes[0], hit->distance) == FLT_MAX)
+        return false;
+
+    // Visit the nearer child first so hits shrink the search early, the farther one waits on the stack with its entry distance
+    uint32_t stack[BVH_MAX_DEPTH];
+    float stack_distances[BVH_MAX_DEPTH];
+    int stack_size = 0;
+    uint32_t node_index = 0;
+    while (true)
+    {
+        const BvhNode& node = bvh.nodes[node_index];
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.left_first; i < node.left_first + node.count; i++)
+            {
+                uint32_t t = bvh.triangles[i];
+                const uint32_t* triangle = &indices[t * 3];
+                if (IntersectTriangle(origin, direction, positions[triangle[0]], positions[triangle[1]], positions[triangle[2]], hit))
+                    hit->triangle = (int)t;
+            }
+        }
+        else
+        {
+            uint32_t near_index = node.left_first;
+            uint32_t far_index = node.left_first + 1;
+            float near_distance = IntersectNode(ray, bvh.nodes[near_index], hit->distance);
+            float far_distance = IntersectNode(ray, bvh.nodes[far_index], hit->distance);
+            if (far_distance < near_distance)
+            {
+                std::swap(near_index, far_index);
+                std::swap(near_distance, far_distance);
+            }
+
+            if (near_distance != FLT_MAX)
+            {
+                if (far_distance != FLT_MAX)
+                {
+                    assert(stack_size < BVH_MAX_DEPTH);
+                    stack[stack_size] = far_index;
+                    stack_distances[stack_size] = far_distance;
+                    stack_size++;
+                }
+                node_index = near_index;
+                continue;
+            }
+        }
+
+        // Skip anything that starts beyond the closest hit so far
+        do
+        {
+            if (stack_size == 0)
+                return hit->triangle >= 0;
+            stack_size--;
+        } while (stack_distances[stack_size] >= hit->distance);
+        node_index = stack[stack_size];
+    }
+}
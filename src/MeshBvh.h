@@ -0,0 +1,36 @@
+#pragma once
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+#include "raymath.h"
+
+// 32 bytes so siblings (which are always adjacent) share a cache line
+struct BvhNode
+{
+    Vector3 min;
+    uint32_t left_first;    // Interior: index of the left child (the right child follows it). Leaf: first entry in MeshBvh::triangles.
+    Vector3 max;
+    uint32_t count;         // Triangles in a leaf, 0 for interior nodes
+};
+
+// Bounding volume hierarchy over the triangles of an index buffer, nodes[0] is the root
+struct MeshBvh
+{
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> triangles;    // Triangle numbers (first index at triangle * 3) grouped by leaf
+};
+
+struct RayHit
+{
+    int triangle = -1;          // -1 if nothing was hit
+    float u = 0.0f;             // Barycentrics: hit = (1 - u - v) * p0 + u * p1 + v * p2
+    float v = 0.0f;
+    float distance = FLT_MAX;   // In units of the ray direction's length
+};
+
+// Binned surface area heuristic build. Large subtrees are built on the job threads.
+void BuildMeshBvh(MeshBvh* bvh, const std::vector<uint32_t>& indices, const std::vector<Vector3>& positions);
+
+// Closest triangle hit by origin + direction * t for 0 <= t < max_distance (triangles are double-sided)
+bool RaycastBvh(const MeshBvh& bvh, const std::vector<uint32_t>& indices, const std::vector<Vector3>& positions,
+    Vector3 origin, Vector3 direction, RayHit* hit, float max_distance = FLT_MAX);
@@ -0,0 +1,187 @@
+#include "MeshCache.h"
+#include "File.h"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#define MESH_CACHE_MAGIC 0x4853454Du // "MESH"
+#define MESH_CACHE_ALIGNMENT 64      // Blobs start on cache-line boundaries so they can be handed to the GPU as-is
+
+struct MeshCacheBlob
+{
+    uint64_t offset;    // Bytes from the start of the file
+    uint64_t count;     // Number of elements
+};
+
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+
+    uint64_t source_hash;   // Hash of the source path
+    uint64_t source_size;
+    uint64_t source_mtime;
+
+    int32_t vertex_count;   // Mesh::vertex_count
+    uint32_t quantized;     // Mesh::quantized the streams were built for
+    uint32_t vertex_stride;
+    uint32_t index_type;    // Of index_stream
+    MeshQuantization quantization;
+
+    // CPU-side data, only what the mesh keeps after loading
+    MeshCacheBlob positions;
+    MeshCacheBlob indices;
+    MeshCacheBlob lods;
+
+    // Uploaded straight from the mapping
+    MeshCacheBlob vertex_stream;
+    MeshCacheBlob index_stream;
+};
+
+static std::string CachePath(const char* path)
+{
+    const char* name = strrchr(path, '/');
+    name = name != nullptr ? name + 1 : path;
+
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)HashString(path));
+    return std::string(MESH_CACHE_DIRECTORY) + "/" + name + "." + hash + ".mesh";
+}
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(uint64_t)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+static bool ValidBlob(const MappedFile& file, const MeshCacheBlob& blob, size_t stride)
+{
+    return blob.offset % MESH_CACHE_ALIGNMENT == 0 && blob.offset + blob.count * stride <= file.size;
+}
+
+template<typename T>
+static void ReadBlob(std::vector<T>* values, const MappedFile& file, const MeshCacheBlob& blob)
+{
+    const T* data = reinterpret_cast<const T*>(file.data + blob.offset);
+    values->assign(data, data + blob.count);
+}
+
+static void WriteBlob(FILE* file, MeshCacheBlob* blob, const void* data, size_t count, size_t stride, uint64_t* offset)
+{
+    static const uint8_t padding[MESH_CACHE_ALIGNMENT]{};
+    uint64_t aligned = AlignOffset(*offset);
+    fwrite(padding, 1, aligned - *offset, file);
+    fwrite(data, stride, count, file);
+
+    blob->offset = aligned;
+    blob->count = count;
+    *offset = aligned + count * stride;
+}
+
+bool MapMeshCache(MeshCacheView* view, Mesh* mesh, const char* path, int vertex_stride)
+{
+    uint64_t size, mtime;
+    if (!FileInfo(path, &size, &mtime))
+        return false;
+
+    MappedFile& file = view->file;
+    if (!MapFile(&file, CachePath(path).c_str()))
+        return false;
+
+    const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(file.data);
+    bool valid =
+        file.size >= sizeof(MeshCacheHeader) &&
+        header->magic == MESH_CACHE_MAGIC &&
+        header->version == MESH_CACHE_VERSION &&
+        header->source_hash == HashString(path) &&
+        header->source_size == size &&
+        header->source_mtime == mtime &&
+        header->quantized == (mesh->quantized ? 1u : 0u) &&
+        header->vertex_stride == (uint32_t)vertex_stride &&
+        (header->index_type == GL_UNSIGNED_SHORT || header->index_type == GL_UNSIGNED_INT) &&
+        header->positions.count > 0 &&
+        header->vertex_stream.count == header->positions.count &&
+        ValidBlob(file, header->positions, sizeof(Vector3)) &&
+        ValidBlob(file, header->indices, sizeof(uint32_t)) &&
+        ValidBlob(file, header->lods, sizeof(MeshLod)) &&
+        ValidBlob(file, header->vertex_stream, header->vertex_stride) &&
+        ValidBlob(file, header->index_stream, IndexTypeSize(header->index_type));
+
+    if (!valid)
+    {
+        printf("Mesh cache for %s is stale, re-importing\n", path);
+        UnmapFile(&file);
+        return false;
+    }
+
+    // The bvh needs positions & 32-bit indices on the CPU, everything else the GPU reads from the streams
+    mesh->vertex_count = header->vertex_count;
+    mesh->quantization = header->quantization;
+    ReadBlob(&mesh->positions, file, header->positions);
+    ReadBlob(&mesh->indices, file, header->indices);
+    ReadBlob(&mesh->lods, file, header->lods);
+
+    MeshStreams& streams = view->streams;
+    streams.vertices = file.data + header->vertex_stream.offset;
+    streams.vertex_count = (int)header->vertex_stream.count;
+    streams.vertex_stride = vertex_stride;
+    streams.indices = file.data + header->index_stream.offset;
+    streams.index_count = (int)header->index_stream.count;
+    streams.index_type = header->index_type;
+    return true;
+}
+
+void UnmapMeshCache(MeshCacheView* view)
+{
+    UnmapFile(&view->file);
+    view->streams = MeshStreams();
+}
+
+void SaveMeshCache(const Mesh& mesh, const MeshStreams& streams, const char* path)
+{
+    MeshCacheHeader header{};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.source_hash = HashString(path);
+    header.vertex_count = mesh.vertex_count;
+    header.quantized = mesh.quantized ? 1 : 0;
+    header.vertex_stride = streams.vertex_stride;
+    header.index_type = streams.index_type;
+    header.quantization = mesh.quantization;
+    if (!FileInfo(path, &header.source_size, &header.source_mtime))
+        return;
+
+    if (!MakeDirectory(MESH_CACHE_DIRECTORY))
+    {
+        printf("Warning: could not create mesh cache directory %s\n", MESH_CACHE_DIRECTORY);
+        return;
+    }
+
+    std::string cache_path = CachePath(path);
+    FILE* file = fopen(cache_path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        printf("Warning: could not write mesh cache %s\n", cache_path.c_str());
+        return;
+    }
+
+    // Header is written last once the blob offsets are known
+    uint64_t offset = sizeof(MeshCacheHeader);
+    fseek(file, (long)offset, SEEK_SET);
+    WriteBlob(file, &header.positions, mesh.positions.data(), mesh.positions.size(), sizeof(Vector3), &offset);
+    WriteBlob(file, &header.indices, mesh.indices.data(), mesh.indices.size(), sizeof(uint32_t), &offset);
+    WriteBlob(file, &header.lods, mesh.lods.data(), mesh.lods.size(), sizeof(MeshLod), &offset);
+    WriteBlob(file, &header.vertex_stream, streams.vertices, streams.vertex_count, streams.vertex_stride, &offset);
+    WriteBlob(file, &header.index_stream, streams.indices, streams.index_count, IndexTypeSize(streams.index_type), &offset);
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    bool failed = ferror(file) != 0;
+    fclose(file);
+
+    if (failed)
+    {
+        printf("Warning: failed writing mesh cache %s\n", cache_path.c_str());
+        remove(cache_path.c_str());
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "Mesh.h"
+#include "File.h"
+
+// Binary mesh cache so obj files are only parsed on first load.
+// Cache files live in MESH_CACHE_DIRECTORY and are keyed on the source path, size and modification time.
+// Bump MESH_CACHE_VERSION whenever the layout or the import pipeline output changes!
+#define MESH_CACHE_DIRECTORY "./assets/cache"
+#define MESH_CACHE_VERSION 6
+
+// A mesh's vertices & indices exactly as the GPU reads them: interleaved vertices in the mesh's vertex format
+// and the full-detail indices followed by those of every other lod, narrowed to index_type
+struct MeshStreams
+{
+    const void* vertices = nullptr;
+    int vertex_count = 0;
+    int vertex_stride = 0;
+
+    const void* indices = nullptr;
+    int index_count = 0;
+    GLenum index_type = GL_UNSIGNED_SHORT;
+};
+
+// A mapped cache file, streams point into the mapping until UnmapMeshCache
+struct MeshCacheView
+{
+    MappedFile file;
+    MeshStreams streams;
+};
+
+// Maps the cache of path, returns false if it's missing, stale or was written for another vertex format.
+// On success mesh gets the CPU-side data it keeps (positions & indices for its bvh, lods and quantization)
+// and view->streams can be uploaded as-is.
+bool MapMeshCache(MeshCacheView* view, Mesh* mesh, const char* path, int vertex_stride);
+void UnmapMeshCache(MeshCacheView* view);
+
+// Writes the CPU-side data of mesh (loaded from path) along with the streams it was uploaded from
+void SaveMeshCache(const Mesh& mesh, const MeshStreams& streams, const char* path);
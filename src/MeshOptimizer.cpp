@@ -0,0 +1,332 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+// Forsyth's scoring constants (https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html)
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_CACHE_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRIANGLE_SCORE 0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.0f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+static float ForsythVertexScore(int cache_position, int active_triangles)
+{
+    // No triangles left to draw means this vertex is useless to us
+    if (active_triangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cache_position >= 0)
+    {
+        // The 3 most recent vertices were used by the last triangle, so we don't want to immediately reuse them (strips are worse than fans)
+        if (cache_position < 3)
+        {
+            score = FORSYTH_LAST_TRIANGLE_SCORE;
+        }
+        else
+        {
+            float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = powf(1.0f - (cache_position - 3) * scale, FORSYTH_CACHE_DECAY_POWER);
+        }
+    }
+
+    // Boost vertices with few triangles remaining so we don't leave lone triangles behind
+    score += FORSYTH_VALENCE_BOOST_SCALE * powf((float)active_triangles, -FORSYTH_VALENCE_BOOST_POWER);
+    return score;
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertex_count, int cache_size)
+{
+    VertexCacheStats stats;
+    if (indices.empty())
+        return stats;
+
+    // A vertex is in the FIFO if fewer than cache_size misses happened since it was last inserted
+    std::vector<int> timestamps(vertex_count, -cache_size - 1);
+    std::vector<bool> referenced(vertex_count, false);
+    int time = 0;
+    size_t unique = 0;
+    for (uint32_t index : indices)
+    {
+        assert(index < vertex_count);
+        if (time - timestamps[index] >= cache_size)
+            timestamps[index] = ++time;
+
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            unique++;
+        }
+    }
+
+    stats.acmr = time / (indices.size() / 3.0f);
+    stats.atvr = time / (float)unique;
+    return stats;
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>* indices, size_t vertex_count)
+{
+    assert(indices->size() % 3 == 0);
+    size_t triangle_count = indices->size() / 3;
+    if (triangle_count == 0)
+        return;
+
+    const std::vector<uint32_t>& input = *indices;
+
+    // Vertex -> triangle adjacency. Each vertex's list is partitioned into [active, emitted) by swapping on emit.
+    std::vector<int> active_triangles(vertex_count, 0);
+    for (uint32_t index : input)
+        active_triangles[index]++;
+
+    std::vector<size_t> adjacency_offsets(vertex_count + 1, 0);
+    for (size_t i = 0; i < vertex_count; i++)
+        adjacency_offsets[i + 1] = adjacency_offsets[i] + active_triangles[i];
+
+    std::vector<uint32_t> adjacency(input.size());
+    std::vector<size_t> adjacency_fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+    for (size_t i = 0; i < input.size(); i++)
+        adjacency[adjacency_fill[input[i]]++] = (uint32_t)(i / 3);
+
+    std::vector<int> cache_positions(vertex_count, -1);
+    std::vector<float> vertex_scores(vertex_count);
+    for (size_t i = 0; i < vertex_count; i++)
+        vertex_scores[i] = ForsythVertexScore(-1, active_triangles[i]);
+
+    std::vector<float> triangle_scores(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    int best_triangle = 0;
+    for (size_t i = 0; i < triangle_count; i++)
+    {
+        triangle_scores[i] = vertex_scores[input[i * 3 + 0]] + vertex_scores[input[i * 3 + 1]] + vertex_scores[input[i * 3 + 2]];
+        if (triangle_scores[i] > triangle_scores[best_triangle])
+            best_triangle = (int)i;
+    }
+
+    // Cache holds 3 extra slots so the vertices pushed out by the newest triangle can have their scores updated
+    int cache[FORSYTH_CACHE_SIZE + 3];
+    int cache_count = 0;
+
+    std::vector<uint32_t> output;
+    output.reserve(input.size());
+    size_t cursor = 0;
+    for (size_t n = 0; n < triangle_count; n++)
+    {
+        // Nothing in the cache has triangles left, so restart from the next triangle we haven't drawn yet
+        if (best_triangle < 0)
+        {
+            while (emitted[cursor])
+                cursor++;
+            best_triangle = (int)cursor;
+        }
+
+        const uint32_t* triangle = &input[best_triangle * 3];
+        output.push_back(triangle[0]);
+        output.push_back(triangle[1]);
+        output.push_back(triangle[2]);
+        emitted[best_triangle] = true;
+
+        // Move the emitted triangle out of each vertex's active range
+        for (int i = 0; i < 3; i++)
+        {
+            uint32_t vertex = triangle[i];
+            uint32_t* begin = &adjacency[adjacency_offsets[vertex]];
+            uint32_t* end = begin + active_triangles[vertex];
+            std::swap(*std::find(begin, end, (uint32_t)best_triangle), *(end - 1));
+            active_triangles[vertex]--;
+        }
+
+        // Most recently used vertices go to the front of the cache (LRU)
+        int next_cache[FORSYTH_CACHE_SIZE + 3];
+        int next_count = 0;
+        for (int i = 0; i < 3; i++)
+            next_cache[next_count++] = triangle[i];
+        for (int i = 0; i < cache_count; i++)
+        {
+            int vertex = cache[i];
+            if (vertex != (int)triangle[0] && vertex != (int)triangle[1] && vertex != (int)triangle[2])
+                next_cache[next_count++] = vertex;
+        }
+        cache_count = std::min(next_count, FORSYTH_CACHE_SIZE);
+        std::copy(next_cache, next_cache + cache_count, cache);
+
+        // Re-score every vertex whose cache position changed (including evicted ones) and propagate to their triangles
+        best_triangle = -1;
+        float best_score = -1.0f;
+        for (int i = 0; i < next_count; i++)
+        {
+            int vertex = next_cache[i];
+            cache_positions[vertex] = i < FORSYTH_CACHE_SIZE ? i : -1;
+
+            float score = ForsythVertexScore(cache_positions[vertex], active_triangles[vertex]);
+            float delta = score - vertex_scores[vertex];
+            vertex_scores[vertex] = score;
+
+            const uint32_t* adjacent = &adjacency[adjacency_offsets[vertex]];
+            for (int j = 0; j < active_triangles[vertex]; j++)
+                triangle_scores[adjacent[j]] += delta;
+        }
+
+        // Only triangles touching the cache are candidates, everything else would be a full cache miss anyway
+        for (int i = 0; i < cache_count; i++)
+        {
+            int vertex = cache[i];
+            const uint32_t* adjacent = &adjacency[adjacency_offsets[vertex]];
+            for (int j = 0; j < active_triangles[vertex]; j++)
+            {
+                uint32_t candidate = adjacent[j];
+                if (triangle_scores[candidate] > best_score)
+                {
+                    best_score = triangle_scores[candidate];
+                    best_triangle = (int)candidate;
+                }
+            }
+        }
+    }
+
+    *indices = std::move(output);
+}
+
+struct TriangleCluster
+{
+    size_t begin;   // First index
+    size_t end;     // One past the last index
+    float sort_key;
+};
+
+void OptimizeOverdraw(std::vector<uint32_t>* indices, const std::vector<Vector3>& positions, float threshold)
+{
+    const int cache_size = 16;
+    const std::vector<uint32_t>& input = *indices;
+    size_t triangle_count = input.size() / 3;
+    if (triangle_count < 2)
+        return;
+
+    // Split into clusters wherever the cache-optimized order restarts (all 3 vertices miss).
+    // Reordering whole clusters therefore barely affects cache efficiency.
+    std::vector<TriangleCluster> clusters;
+    std::vector<int> timestamps(positions.size(), -cache_size - 1);
+    int time = 0;
+    for (size_t i = 0; i < triangle_count; i++)
+    {
+        int misses = 0;
+        for (int j = 0; j < 3; j++)
+        {
+            uint32_t index = input[i * 3 + j];
+            if (time - timestamps[index] >= cache_size)
+            {
+                timestamps[index] = ++time;
+                misses++;
+            }
+        }
+
+        if (i == 0 || misses == 3)
+            clusters.push_back({ i * 3, i * 3, 0.0f });
+        clusters.back().end = i * 3 + 3;
+    }
+
+    if (clusters.size() < 2)
+        return;
+
+    // Area-weighted centroid of the whole mesh
+    Vector3 mesh_centroid = Vector3Zeros;
+    float mesh_area = 0.0f;
+    for (size_t i = 0; i < input.size(); i += 3)
+    {
+        Vector3 a = positions[input[i + 0]];
+        Vector3 b = positions[input[i + 1]];
+        Vector3 c = positions[input[i + 2]];
+        float area = Vector3Length(Vector3CrossProduct(b - a, c - a));
+        mesh_centroid += (a + b + c) * (area / 3.0f);
+        mesh_area += area;
+    }
+    if (mesh_area > 0.0f)
+        mesh_centroid /= mesh_area;
+
+    // Clusters that face away from the centre are likely to occlude the rest of the mesh, so draw them first
+    for (TriangleCluster& cluster : clusters)
+    {
+        Vector3 centroid = Vector3Zeros;
+        Vector3 normal = Vector3Zeros;
+        float area = 0.0f;
+        for (size_t i = cluster.begin; i < cluster.end; i += 3)
+        {
+            Vector3 a = positions[input[i + 0]];
+            Vector3 b = positions[input[i + 1]];
+            Vector3 c = positions[input[i + 2]];
+            Vector3 cross = Vector3CrossProduct(b - a, c - a);
+            float triangle_area = Vector3Length(cross);
+            centroid += (a + b + c) * (triangle_area / 3.0f);
+            normal += cross;
+            area += triangle_area;
+        }
+
+        if (area > 0.0f)
+            centroid /= area;
+        cluster.sort_key = Vector3DotProduct(centroid - mesh_centroid, Vector3Normalize(normal));
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(),
+        [](const TriangleCluster& a, const TriangleCluster& b) { return a.sort_key > b.sort_key; });
+
+    std::vector<uint32_t> output;
+    output.reserve(input.size());
+    for (const TriangleCluster& cluster : clusters)
+        output.insert(output.end(), input.begin() + cluster.begin, input.begin() + cluster.end);
+
+    float acmr_before = AnalyzeVertexCache(input, positions.size(), cache_size).acmr;
+    float acmr_after = AnalyzeVertexCache(output, positions.size(), cache_size).acmr;
+    if (acmr_after <= acmr_before * threshold)
+        *indices = std::move(output);
+}
+
+void OptimizeVertexFetch(Mesh* mesh)
+{
+    const uint32_t unused = ~0u;
+    std::vector<uint32_t> remap(mesh->positions.size(), unused);
+    uint32_t vertex_count = 0;
+    for (uint32_t& index : mesh->indices)
+    {
+        if (remap[index] == unused)
+            remap[index] = vertex_count++;
+        index = remap[index];
+    }
+
+    std::vector<Vector3> positions(vertex_count);
+    std::vector<Vector2> tcoords(mesh->tcoords.empty() ? 0 : vertex_count);
+    std::vector<Vector3> normals(mesh->normals.empty() ? 0 : vertex_count);
+    for (size_t i = 0; i < remap.size(); i++)
+    {
+        uint32_t j = remap[i];
+        if (j == unused)
+            continue;
+
+        positions[j] = mesh->positions[i];
+        if (!tcoords.empty())
+            tcoords[j] = mesh->tcoords[i];
+        if (!normals.empty())
+            normals[j] = mesh->normals[i];
+    }
+
+    mesh->positions = std::move(positions);
+    mesh->tcoords = std::move(tcoords);
+    mesh->normals = std::move(normals);
+}
+
+void OptimizeMesh(Mesh* mesh, bool overdraw)
+{
+    if (mesh->indices.empty())
+        return;
+
+    VertexCacheStats before = AnalyzeVertexCache(mesh->indices, mesh->positions.size());
+
+    OptimizeVertexCache(&mesh->indices, mesh->positions.size());
+    if (overdraw)
+        OptimizeOverdraw(&mesh->indices, mesh->positions);
+    OptimizeVertexFetch(mesh);
+
+    VertexCacheStats after = AnalyzeVertexCache(mesh->indices, mesh->positions.size());
+    printf("Optimized mesh (%zu triangles): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+        mesh->indices.size() / 3, before.acmr, after.acmr, before.atvr, after.atvr);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "Mesh.h"
+
+// Post-transform vertex cache statistics for an index buffer
+struct VertexCacheStats
+{
+    float acmr = 0.0f;  // Average cache miss ratio: transformed vertices per triangle (0.5 is ideal, 3.0 is worst)
+    float atvr = 0.0f;  // Average transform to vertex ratio: transformed vertices per unique vertex (1.0 is ideal)
+};
+
+// Simulates a FIFO post-transform cache of cache_size entries (16 is typical of desktop GPUs)
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertex_count, int cache_size = 16);
+
+// Reorders triangles for post-transform cache locality (Tom Forsyth's linear-speed vertex cache optimisation)
+void OptimizeVertexCache(std::vector<uint32_t>* indices, size_t vertex_count);
+
+// Reorders clusters of cache-optimized triangles so outward-facing clusters are drawn first (less overdraw).
+// Clusters are only reordered if ACMR stays within threshold times the cache-optimized ACMR.
+void OptimizeOverdraw(std::vector<uint32_t>* indices, const std::vector<Vector3>& positions, float threshold = 1.05f);
+
+// Reorders vertices (and remaps indices) so vertices are stored in the order they're first referenced
+void OptimizeVertexFetch(Mesh* mesh);
+
+// Runs the above passes on mesh and prints ACMR/ATVR before and after
+void OptimizeMesh(Mesh* mesh, bool overdraw = true);
@@ -0,0 +1,323 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+// Symmetric 4x4 error matrix of the plane equations ax + by + cz + d = 0 accumulated onto a vertex
+struct Quadric
+{
+    double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+    double b2 = 0.0, bc = 0.0, bd = 0.0;
+    double c2 = 0.0, cd = 0.0;
+    double d2 = 0.0;
+    double weight = 0.0;
+};
+
+static Quadric QuadricFromTriangle(Vector3 p0, Vector3 p1, Vector3 p2)
+{
+    Vector3 normal = Vector3CrossProduct(p1 - p0, p2 - p0);
+    float area = Vector3Length(normal);
+    Quadric q;
+    if (area == 0.0f)
+        return q;
+
+    // Weigh planes by area so big triangles matter more than slivers
+    normal /= area;
+    double a = normal.x, b = normal.y, c = normal.z;
+    double d = -Vector3DotProduct(normal, p0);
+    double w = area;
+    q.a2 = a * a * w; q.ab = a * b * w; q.ac = a * c * w; q.ad = a * d * w;
+    q.b2 = b * b * w; q.bc = b * c * w; q.bd = b * d * w;
+    q.c2 = c * c * w; q.cd = c * d * w;
+    q.d2 = d * d * w;
+    q.weight = w;
+    return q;
+}
+
+static void QuadricAdd(Quadric* q, const Quadric& other)
+{
+    q->a2 += other.a2; q->ab += other.ab; q->ac += other.ac; q->ad += other.ad;
+    q->b2 += other.b2; q->bc += other.bc; q->bd += other.bd;
+    q->c2 += other.c2; q->cd += other.cd;
+    q->d2 += other.d2;
+    q->weight += other.weight;
+}
+
+// Weighted mean squared distance from p to the planes of q
+static float QuadricError(const Quadric& q, Vector3 p)
+{
+    double x = p.x, y = p.y, z = p.z;
+    double error =
+        q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x +
+        q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y +
+        q.c2 * z * z + 2.0 * q.cd * z +
+        q.d2;
+    return q.weight > 0.0 ? (float)(fabs(error) / q.weight) : 0.0f;
+}
+
+struct Collapse
+{
+    uint32_t from;
+    uint32_t to;
+    float error;
+};
+
+struct Vector3Hash
+{
+    size_t operator()(const Vector3& v) const
+    {
+        uint32_t bits[3];
+        memcpy(bits, &v, sizeof(bits));
+        return (size_t)((bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u));
+    }
+};
+
+// Rejects a collapse if moving "from" onto "to" would flip any of the remaining triangles around "from"
+static bool CollapseFlips(const std::vector<uint32_t>& indices, const std::vector<Vector3>& positions,
+    const uint32_t* triangles, size_t triangle_count, uint32_t from, uint32_t to)
+{
+    for (size_t i = 0; i < triangle_count; i++)
+    {
+        const uint32_t* triangle = &indices[triangles[i] * 3];
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+            continue; // Becomes degenerate and gets removed
+
+        Vector3 before[3], after[3];
+        for (int j = 0; j < 3; j++)
+        {
+            before[j] = positions[triangle[j]];
+            after[j] = triangle[j] == from ? positions[to] : before[j];
+        }
+
+        Vector3 n0 = Vector3CrossProduct(before[1] - before[0], before[2] - before[0]);
+        Vector3 n1 = Vector3CrossProduct(after[1] - after[0], after[2] - after[0]);
+        if (Vector3DotProduct(n0, n1) <= 0.0f)
+            return true;
+    }
+    return false;
+}
+
+std::vector<uint32_t> SimplifyMesh(const std::vector<uint32_t>& indices, const std::vector<Vector3>& positions,
+    size_t target_index_count, float max_error, float* result_error)
+{
+    assert(indices.size() % 3 == 0);
+    size_t vertex_count = positions.size();
+    std::vector<uint32_t> result = indices;
+    float error = 0.0f;
+
+    // Vertices that share a position (uv/normal seams) share a quadric
+    std::vector<uint32_t> groups(vertex_count);
+    std::vector<uint32_t> group_sizes;
+    {
+        std::unordered_map<Vector3, uint32_t, Vector3Hash> unique;
+        unique.reserve(vertex_count);
+        for (size_t i = 0; i < vertex_count; i++)
+        {
+            auto it = unique.emplace(positions[i], (uint32_t)group_sizes.size()).first;
+            if (it->second == group_sizes.size())
+                group_sizes.push_back(0);
+            groups[i] = it->second;
+            group_sizes[it->second]++;
+        }
+    }
+
+    std::vector<Quadric> quadrics(group_sizes.size());
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        Quadric q = QuadricFromTriangle(positions[result[i + 0]], positions[result[i + 1]], positions[result[i + 2]]);
+        for (int j = 0; j < 3; j++)
+            QuadricAdd(&quadrics[groups[result[i + j]]], q);
+    }
+
+    // An edge (between position groups) used by only one triangle is on an open border
+    std::vector<bool> locked(vertex_count, false);
+    {
+        std::unordered_map<uint64_t, int> edges;
+        edges.reserve(result.size());
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                uint32_t a = groups[result[i + j]];
+                uint32_t b = groups[result[i + (j + 1) % 3]];
+                uint64_t key = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+                edges[key]++;
+            }
+        }
+
+        std::vector<bool> border_groups(group_sizes.size(), false);
+        for (const auto& edge : edges)
+        {
+            if (edge.second == 1)
+            {
+                border_groups[edge.first >> 32] = true;
+                border_groups[edge.first & 0xFFFFFFFF] = true;
+            }
+        }
+
+        for (size_t i = 0; i < vertex_count; i++)
+            locked[i] = group_sizes[groups[i]] > 1 || border_groups[groups[i]];
+    }
+
+    std::vector<uint32_t> adjacency_offsets(vertex_count + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<bool> touched(vertex_count);
+    std::vector<uint32_t> remap(vertex_count);
+    while (result.size() > target_index_count)
+    {
+        // Vertex -> triangle adjacency of the current index buffer
+        std::fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0);
+        for (uint32_t index : result)
+            adjacency_offsets[index + 1]++;
+        for (size_t i = 0; i < vertex_count; i++)
+            adjacency_offsets[i + 1] += adjacency_offsets[i];
+
+        adjacency.resize(result.size());
+        std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+        for (size_t i = 0; i < result.size(); i++)
+            adjacency[fill[result[i]]++] = (uint32_t)(i / 3);
+
+        // Cheapest valid direction of every edge
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                uint32_t a = result[i + j];
+                uint32_t b = result[i + (j + 1) % 3];
+                if (a > b)
+                    continue; // Each edge is visited from both of its triangles, only keep one
+
+                Quadric q = quadrics[groups[a]];
+                QuadricAdd(&q, quadrics[groups[b]]);
+
+                Collapse collapse{ a, b, FLT_MAX };
+                if (!locked[a])
+                    collapse = { a, b, QuadricError(q, positions[b]) };
+                if (!locked[b])
+                {
+                    float error_ba = QuadricError(q, positions[a]);
+                    if (error_ba < collapse.error)
+                        collapse = { b, a, error_ba };
+                }
+
+                if (collapse.error < FLT_MAX)
+                    collapses.push_back(collapse);
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(),
+            [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+        if (collapses.empty())
+            break;
+
+        // Each collapse removes about 2 triangles. Collapses touching the same neighbourhood wait for the next pass,
+        // and so do collapses much costlier than the ones we're aiming for (they may become cheap after this pass).
+        size_t collapse_limit = std::max<size_t>((result.size() - target_index_count) / 6, 1);
+        float pass_error = collapses[std::min(collapse_limit, collapses.size()) - 1].error * 1.5f;
+        size_t collapse_count = 0;
+        std::fill(touched.begin(), touched.end(), false);
+        for (size_t i = 0; i < vertex_count; i++)
+            remap[i] = (uint32_t)i;
+
+        for (const Collapse& collapse : collapses)
+        {
+            if (collapse_count >= collapse_limit || collapse.error > pass_error || sqrtf(collapse.error) > max_error)
+                break;
+
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            const uint32_t* triangles = &adjacency[adjacency_offsets[collapse.from]];
+            size_t triangle_count = adjacency_offsets[collapse.from + 1] - adjacency_offsets[collapse.from];
+            if (CollapseFlips(result, positions, triangles, triangle_count, collapse.from, collapse.to))
+                continue;
+
+            for (size_t j = 0; j < triangle_count; j++)
+            {
+                const uint32_t* triangle = &result[triangles[j] * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+            }
+
+            remap[collapse.from] = collapse.to;
+            QuadricAdd(&quadrics[groups[collapse.to]], quadrics[groups[collapse.from]]);
+            error = std::max(error, collapse.error);
+            collapse_count++;
+        }
+
+        if (collapse_count == 0)
+            break;
+
+        // Apply collapses and drop triangles that became degenerate
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            uint32_t a = remap[result[i + 0]];
+            uint32_t b = remap[result[i + 1]];
+            uint32_t c = remap[result[i + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (result_error != nullptr)
+        *result_error = sqrtf(error);
+    return result;
+}
+
+void GenerateMeshLods(Mesh* mesh)
+{
+    mesh->lods.clear();
+    mesh->lod_indices.clear();
+    if (mesh->indices.empty())
+        return;
+
+    mesh->lods.push_back({ 0, (int)mesh->indices.size(), 0.0f });
+
+    Vector3 min = mesh->positions[0];
+    Vector3 max = mesh->positions[0];
+    for (Vector3 position : mesh->positions)
+    {
+        min = Vector3Min(min, position);
+        max = Vector3Max(max, position);
+    }
+    float max_error = Vector3Distance(min, max) * 0.1f;
+
+    // Simplify each level from the full-detail mesh so its error is relative to LOD 0 rather than the previous level
+    size_t previous_count = mesh->indices.size();
+    for (int i = 1; i < MESH_LOD_MAX; i++)
+    {
+        size_t target_count = (mesh->indices.size() >> i) / 3 * 3;
+        if (target_count < 3 * 32)
+            break;
+
+        float error;
+        std::vector<uint32_t> lod = SimplifyMesh(mesh->indices, mesh->positions, target_count, max_error, &error);
+        if (lod.empty() || lod.size() > previous_count * 9 / 10)
+            break; // Simplification stalled (locked seams or borders), further levels would be near-duplicates
+
+        OptimizeVertexCache(&lod, mesh->positions.size());
+
+        MeshLod level;
+        level.index_offset = (int)(mesh->indices.size() + mesh->lod_indices.size());
+        level.index_count = (int)lod.size();
+        level.error = error;
+        mesh->lods.push_back(level);
+        mesh->lod_indices.insert(mesh->lod_indices.end(), lod.begin(), lod.end());
+        previous_count = lod.size();
+
+        printf("LOD %i: %zu triangles, error %f\n", i, lod.size() / 3, error);
+    }
+}
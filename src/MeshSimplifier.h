@@ -0,0 +1,12 @@
+#pragma once
+#include "Mesh.h"
+
+// Quadric edge-collapse simplification (Garland & Heckbert) that only collapses onto existing vertices,
+// so every level of detail can share the original vertex buffer.
+// Vertices on open borders and uv/normal seams are locked so simplification doesn't tear the mesh.
+// Returns the simplified index buffer, result_error is the RMS distance (object-space) the surface moved by.
+std::vector<uint32_t> SimplifyMesh(const std::vector<uint32_t>& indices, const std::vector<Vector3>& positions,
+    size_t target_index_count, float max_error, float* result_error);
+
+// Fills mesh->lods and mesh->lod_indices with up to MESH_LOD_MAX levels, each with roughly half the triangles of the last
+void GenerateMeshLods(Mesh* mesh);
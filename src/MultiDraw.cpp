@@ -0,0 +1,147 @@
+#include "MultiDraw.h"
+#include "Buffer.h"
+#include "Window.h"
+#include <cassert>
+#include <cstring>
+
+// Room for 4k draws per frame before the stream has to grow
+#define MULTI_DRAW_STREAM_SIZE (4096 * (sizeof(DrawElementsIndirectCommand) + sizeof(MultiDrawObject)))
+
+void CreateMultiDrawBatch(MultiDrawBatch* batch)
+{
+    assert(batch->draw_id_buffer == GL_NONE);
+    CreateStreamBuffer(&batch->stream, MULTI_DRAW_STREAM_SIZE);
+    batch->draw_id_buffer = CreateBuffer();
+    batch->capacity = 0;
+}
+
+void DestroyMultiDrawBatch(MultiDrawBatch* batch)
+{
+    DestroyStreamBuffer(&batch->stream);
+    DestroyBuffer(&batch->draw_id_buffer);
+    *batch = MultiDrawBatch();
+}
+
+void ClearMultiDrawBatch(MultiDrawBatch* batch)
+{
+    batch->commands16.clear();
+    batch->commands32.clear();
+    batch->objects.clear();
+}
+
+void AddMultiDraw(MultiDrawBatch* batch, const Mesh& mesh, Matrix world, int lod)
+{
+    assert(mesh.index_offset >= 0);
+    if (batch->vao == GL_NONE)
+        batch->vao = mesh.vao;
+    assert(mesh.vao == batch->vao);
+
+    int first = 0;
+    int count = mesh.vertex_count;
+    if (!mesh.lods.empty())
+    {
+        assert(lod >= 0 && lod < (int)mesh.lods.size());
+        first = mesh.lods[lod].index_offset;
+        count = mesh.lods[lod].index_count;
+    }
+
+    DrawElementsIndirectCommand command;
+    command.count = count;
+    command.instance_count = 1;
+    command.first_index = mesh.index_offset / IndexTypeSize(mesh.index_type) + first;
+    command.base_vertex = mesh.base_vertex;
+    command.base_instance = (GLuint)batch->objects.size();
+    if (mesh.index_type == GL_UNSIGNED_SHORT)
+        batch->commands16.push_back(command);
+    else
+        batch->commands32.push_back(command);
+
+    // Fold dequantization into the transform so quantized & float meshes share a shader (identity for float meshes)
+    const MeshQuantization& q = mesh.quantization;
+    Matrix dequantize = MatrixScale(q.position_scale.x, q.position_scale.y, q.position_scale.z) *
+        MatrixTranslate(q.position_offset.x, q.position_offset.y, q.position_offset.z);
+
+    MultiDrawObject object;
+    object.world = MatrixToFloatV(dequantize * world);
+    batch->objects.push_back(object);
+}
+
+static void ReserveDrawIds(MultiDrawBatch* batch)
+{
+    int count = (int)batch->objects.size();
+    if (count > batch->capacity)
+    {
+        int capacity = batch->capacity > 0 ? batch->capacity : 256;
+        while (capacity < count)
+            capacity *= 2;
+        batch->capacity = capacity;
+
+        std::vector<GLuint> draw_ids(capacity);
+        for (int i = 0; i < capacity; i++)
+            draw_ids[i] = i;
+        UpdateBuffer(batch->draw_id_buffer, draw_ids.data(), capacity * sizeof(GLuint));
+    }
+}
+
+void SubmitMultiDrawBatch(MultiDrawBatch* batch)
+{
+    if (batch->objects.empty())
+        return;
+
+    ReserveDrawIds(batch);
+
+    static GLint object_alignment = 0;
+    if (object_alignment == 0)
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &object_alignment);
+
+    // One allocation so growing the stream can't orphan the first half: objects, then 16-bit commands, then 32-bit
+    int object_size = (int)(batch->objects.size() * sizeof(MultiDrawObject));
+    int command16_size = (int)(batch->commands16.size() * sizeof(DrawElementsIndirectCommand));
+    int command32_size = (int)(batch->commands32.size() * sizeof(DrawElementsIndirectCommand));
+    StreamAllocation allocation;
+    AllocateStream(&batch->stream, object_size + command16_size + command32_size, object_alignment, &allocation);
+    uint8_t* data = (uint8_t*)allocation.data;
+    memcpy(data, batch->objects.data(), object_size);
+    memcpy(data + object_size, batch->commands16.data(), command16_size);
+    memcpy(data + object_size + command16_size, batch->commands32.data(), command32_size);
+    FinishStreamAllocation(&batch->stream, &allocation);
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, MULTI_DRAW_OBJECT_BINDING, allocation.buffer, allocation.offset, object_size);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, allocation.buffer);
+
+    BindVertexArray(batch->vao);
+    if (HasDirectStateAccess())
+    {
+        EnableVertexArrayAttribute(batch->vao, MULTI_DRAW_ID_LOCATION);
+        SetVertexArrayAttributeInteger(batch->vao, MULTI_DRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, 0, MULTI_DRAW_ID_BINDING);
+        SetVertexArrayBuffer(batch->vao, MULTI_DRAW_ID_BINDING, batch->draw_id_buffer, 0, sizeof(GLuint));
+        SetVertexArrayDivisor(batch->vao, MULTI_DRAW_ID_BINDING, 1);
+    }
+    else
+    {
+        BindVertexBuffer(batch->draw_id_buffer);
+        EnableVertexAttribute(MULTI_DRAW_ID_LOCATION);
+        SetVertexAttributeInteger(MULTI_DRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, sizeof(GLuint));
+        SetVertexAttributeDivisor(MULTI_DRAW_ID_LOCATION, 1);
+        UnbindVertexBuffer(batch->draw_id_buffer);
+    }
+
+    size_t commands = allocation.offset + object_size;
+    if (!batch->commands16.empty())
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)commands, (GLsizei)batch->commands16.size(), 0);
+
+    if (!batch->commands32.empty())
+    {
+        size_t offset = commands + command16_size;
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)offset, (GLsizei)batch->commands32.size(), 0);
+    }
+
+    UnbindVertexArray(batch->vao);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, GL_NONE);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MULTI_DRAW_OBJECT_BINDING, GL_NONE);
+}
+
+void AdvanceMultiDrawBatch(MultiDrawBatch* batch)
+{
+    AdvanceStreamBuffer(&batch->stream);
+}
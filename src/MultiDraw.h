@@ -0,0 +1,59 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include "Buffer.h"
+#include "Mesh.h"
+
+// What glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER for each draw
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;     // In indices, not bytes
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+// Per-draw data in the shader storage buffer (std430, see multi_draw.vert)
+struct MultiDrawObject
+{
+    float16 world;          // Includes the mesh's position dequantization
+};
+
+// Collects draws of meshes from one geometry arena and submits them all at once.
+// Each draw's base_instance is its object index. The vertex shader gets it from an instanced
+// integer attribute (location 3, read at base_instance since instance_count is 1) rather than
+// gl_DrawID/gl_BaseInstance, which need GL 4.6 or ARB_shader_draw_parameters.
+struct MultiDrawBatch
+{
+    GLuint vao = GL_NONE;               // The arena's vertex array, taken from the first mesh added
+    StreamBuffer stream;                // This frame's commands & objects (shader storage binding 0)
+    GLuint draw_id_buffer = GL_NONE;    // 0, 1, 2... for the instanced draw id attribute
+    int capacity = 0;                   // Draws the draw id buffer covers
+
+    // One list per index type since a multi-draw call reads every draw's indices as the same type
+    std::vector<DrawElementsIndirectCommand> commands16;
+    std::vector<DrawElementsIndirectCommand> commands32;
+    std::vector<MultiDrawObject> objects;
+};
+
+#define MULTI_DRAW_ID_LOCATION 3
+#define MULTI_DRAW_ID_BINDING 2         // Vertex buffer binding point of the draw ids with direct state access
+#define MULTI_DRAW_OBJECT_BINDING 0
+
+void CreateMultiDrawBatch(MultiDrawBatch* batch);
+void DestroyMultiDrawBatch(MultiDrawBatch* batch);
+
+// Forget last frame's draws
+void ClearMultiDrawBatch(MultiDrawBatch* batch);
+
+// Queue mesh at world. Every mesh of a batch must share a vertex array (same arena & slabs).
+void AddMultiDraw(MultiDrawBatch* batch, const Mesh& mesh, Matrix world, int lod = 0);
+
+// Writes the queued draws to the batch's stream and issues them with one glMultiDrawElementsIndirect per index type
+// (usually just one). The shader must be bound and have its view-projection uniform set.
+// Every submit of a frame allocates from the same stream region.
+void SubmitMultiDrawBatch(MultiDrawBatch* batch);
+
+// Call once per frame after the frame's draws: moves the stream on to its next region
+void AdvanceMultiDrawBatch(MultiDrawBatch* batch);
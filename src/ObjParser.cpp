@@ -0,0 +1,398 @@
+#include "ObjParser.h"
+#include "File.h"
+#include "Jobs.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Each thread gets a few chunks so an unlucky chunk full of faces doesn't stall everyone else
+#define OBJ_CHUNKS_PER_THREAD 4
+#define OBJ_MIN_CHUNK_SIZE (256 * 1024)
+
+// Everything parsed from one line-aligned range of the file
+struct ObjChunk
+{
+    const char* begin = nullptr;
+    const char* end = nullptr;
+
+    std::vector<Vector3> positions;
+    std::vector<Vector2> tcoords;
+    std::vector<Vector3> normals;
+
+    // Positive indices are already global. Negative (relative) indices are resolved against this chunk's
+    // attribute counts, so their slot (corner * 3 + attribute) is recorded to add the chunk's base later.
+    std::vector<ObjIndex> indices;
+    std::vector<uint32_t> relative_indices;
+    std::vector<uint32_t> face_vertices;
+};
+
+static const double POWERS_OF_10[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const double NEGATIVE_POWERS_OF_10[] =
+{
+    1e0,   1e-1,  1e-2,  1e-3,  1e-4,  1e-5,  1e-6,  1e-7,  1e-8,  1e-9,  1e-10,
+    1e-11, 1e-12, 1e-13, 1e-14, 1e-15, 1e-16, 1e-17, 1e-18, 1e-19, 1e-20, 1e-21, 1e-22
+};
+
+static bool IsDigit(char c)
+{
+    return (unsigned char)(c - '0') < 10;
+}
+
+static const char* SkipWhitespace(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+static const uint64_t INTEGER_POWERS_OF_10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+
+static int CountTrailingZeros(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (int)index;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+// SWAR (SIMD within a register): converts up to 8 digit values (one per byte, first digit in the lowest byte)
+// with 3 multiplies instead of 8 dependent multiply-adds
+static uint32_t ParseEightDigits(uint64_t digits)
+{
+    digits = (digits * 10) + (digits >> 8);
+    digits = (((digits & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+        (((digits >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+    return (uint32_t)digits;
+}
+
+#define OBJ_MAX_DIGITS 15
+
+// Digits past what a double holds exactly are skipped (and counted) rather than accumulated
+static const char* ParseDigitsScalar(const char* p, const char* end, uint64_t* value, int* count, int* skipped)
+{
+    while (p < end && IsDigit(*p))
+    {
+        if (*count < OBJ_MAX_DIGITS)
+        {
+            *value = *value * 10 + (*p - '0');
+            (*count)++;
+        }
+        else
+        {
+            (*skipped)++;
+        }
+        p++;
+    }
+    return p;
+}
+
+// Accumulates a run of digits into value, 8 bytes at a time where possible
+static inline const char* ParseDigits(const char* p, const char* end, uint64_t* value, int* count, int* skipped)
+{
+    while (end - p >= 8)
+    {
+        uint64_t chars;
+        memcpy(&chars, p, sizeof(chars));
+
+        // Subtracting '0' leaves digits as 0-9. The first non-digit byte either wraps (< '0') or is >= 10,
+        // so adding 0x76 sets its top bit. Bytes after the first non-digit are garbage but get shifted out below.
+        uint64_t digits = chars - 0x3030303030303030ull;
+        uint64_t non_digits = (digits | (digits + 0x7676767676767676ull)) & 0x8080808080808080ull;
+        int length = non_digits != 0 ? CountTrailingZeros(non_digits) / 8 : 8;
+        if (length == 0 || *count + length > OBJ_MAX_DIGITS)
+            break;
+
+        // Move the digits to the top bytes so the bytes below act as leading zeros
+        digits <<= 8 * (8 - length);
+        *value = *value * INTEGER_POWERS_OF_10[length] + ParseEightDigits(digits);
+        *count += length;
+        p += length;
+        if (length < 8)
+            return p;
+    }
+
+    return ParseDigitsScalar(p, end, value, count, skipped);
+}
+
+// Same arithmetic as fast_obj's parse_float so both loaders produce bit-identical meshes
+static const char* ParseFloat(const char* p, const char* end, float* out)
+{
+    p = SkipWhitespace(p, end);
+
+    double sign = 1.0;
+    if (p < end && (*p == '+' || *p == '-'))
+        sign = *p++ == '-' ? -1.0 : 1.0;
+
+    uint64_t integer = 0;
+    int integer_digits = 0;
+    int integer_skipped = 0;
+    p = ParseDigits(p, end, &integer, &integer_digits, &integer_skipped);
+
+    if (p < end && *p == '.')
+        p++;
+
+    uint64_t fraction = 0;
+    int fraction_digits = 0;
+    int fraction_skipped = 0;
+    p = ParseDigits(p, end, &fraction, &fraction_digits, &fraction_skipped);
+
+    double value = (double)integer * (integer_skipped < 23 ? POWERS_OF_10[integer_skipped] : 1e23);
+    value += (double)fraction / POWERS_OF_10[fraction_digits];
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        const double* powers = POWERS_OF_10;
+        if (p < end && (*p == '+' || *p == '-'))
+            powers = *p++ == '-' ? NEGATIVE_POWERS_OF_10 : POWERS_OF_10;
+
+        unsigned int exponent = 0;
+        while (p < end && IsDigit(*p))
+            exponent = exponent * 10 + (*p++ - '0');
+
+        value *= exponent < 23 ? powers[exponent] : 0.0;
+    }
+
+    *out = (float)(sign * value);
+    return p;
+}
+
+static const char* ParseInt(const char* p, const char* end, int* out)
+{
+    int sign = 1;
+    if (p < end && *p == '-')
+    {
+        sign = -1;
+        p++;
+    }
+
+    uint64_t value = 0;
+    int count = 0;
+    int skipped = 0;
+    p = ParseDigits(p, end, &value, &count, &skipped);
+
+    *out = sign * (int)value;
+    return p;
+}
+
+static void ParseFace(ObjChunk* chunk, const char* p, const char* end)
+{
+    const uint32_t counts[3] = { (uint32_t)chunk->positions.size(), (uint32_t)chunk->tcoords.size(), (uint32_t)chunk->normals.size() };
+    uint32_t corner_count = 0;
+    while (true)
+    {
+        p = SkipWhitespace(p, end);
+        if (p >= end || *p == '\n' || *p == '\r' || *p == '#')
+            break;
+
+        int values[3] = { 0, 0, 0 };
+        p = ParseInt(p, end, &values[0]);
+        if (p < end && *p == '/')
+        {
+            p++;
+            if (p < end && *p != '/')
+                p = ParseInt(p, end, &values[1]);
+
+            if (p < end && *p == '/')
+            {
+                p++;
+                p = ParseInt(p, end, &values[2]);
+            }
+        }
+
+        // Skip the rest of the face if there's no valid vertex index (matches fast_obj)
+        if (values[0] == 0)
+            break;
+
+        // Unsigned wrap-around is fine here, a relative index that reaches into an earlier chunk comes out right
+        // once the base is added and anything still out of range is caught after merging
+        uint32_t index[3];
+        for (int i = 0; i < 3; i++)
+        {
+            index[i] = (uint32_t)values[i];
+            if (values[i] < 0)
+            {
+                chunk->relative_indices.push_back((uint32_t)chunk->indices.size() * 3 + i);
+                index[i] += counts[i];
+            }
+        }
+        chunk->indices.push_back({ index[0], index[1], index[2] });
+        corner_count++;
+
+        // Guard against garbage that ParseInt didn't consume
+        if (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r' && *p != '#')
+            break;
+    }
+
+    if (corner_count > 0)
+        chunk->face_vertices.push_back(corner_count);
+}
+
+static void ParseChunk(ObjChunk* chunk)
+{
+    const char* p = chunk->begin;
+    const char* end = chunk->end;
+    // Numbers are parsed against the chunk end rather than the line end, the newline already stops them
+    // and it leaves room for the 8 byte reads in ParseDigits
+    while (p < end)
+    {
+        const char* line_end = (const char*)memchr(p, '\n', end - p);
+        if (line_end == nullptr)
+            line_end = end;
+
+        p = SkipWhitespace(p, line_end);
+        if (line_end - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            Vector3 v;
+            p = ParseFloat(p + 2, end, &v.x);
+            p = ParseFloat(p, end, &v.y);
+            p = ParseFloat(p, end, &v.z);
+            chunk->positions.push_back(v);
+        }
+        else if (line_end - p >= 3 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            Vector2 vt;
+            p = ParseFloat(p + 3, end, &vt.x);
+            p = ParseFloat(p, end, &vt.y);
+            chunk->tcoords.push_back(vt);
+        }
+        else if (line_end - p >= 3 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            Vector3 vn;
+            p = ParseFloat(p + 3, end, &vn.x);
+            p = ParseFloat(p, end, &vn.y);
+            p = ParseFloat(p, end, &vn.z);
+            chunk->normals.push_back(vn);
+        }
+        else if (line_end - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            ParseFace(chunk, p + 2, end);
+        }
+
+        p = line_end + 1;
+    }
+}
+
+// Appends the other chunks' elements after chunk 0's, which is moved rather than copied
+template <typename T>
+static void MergeChunks(std::vector<T>* out, std::vector<ObjChunk>& chunks, std::vector<T> ObjChunk::* member, const std::vector<size_t>& bases)
+{
+    size_t count = bases.back() + (chunks.back().*member).size();
+    *out = std::move(chunks[0].*member);
+    out->resize(count);
+    ParallelFor((int)chunks.size() - 1, [&](int i)
+    {
+        const std::vector<T>& elements = chunks[i + 1].*member;
+        std::copy(elements.begin(), elements.end(), out->begin() + bases[i + 1]);
+    });
+}
+
+bool ParseObjParallel(ObjMesh* obj, const char* path)
+{
+    MappedFile file;
+    if (!MapFile(&file, path))
+        return false;
+
+    const char* data = (const char*)file.data;
+    const char* data_end = data + file.size;
+
+    // Split at line boundaries so no line straddles two chunks. Without worker threads one chunk saves the merge.
+    int thread_count = JobThreadCount();
+    size_t chunk_count = 1;
+    if (thread_count > 1)
+        chunk_count = std::max<size_t>(std::min<size_t>(file.size / OBJ_MIN_CHUNK_SIZE, thread_count * OBJ_CHUNKS_PER_THREAD), 1);
+
+    std::vector<ObjChunk> chunks(chunk_count);
+    const char* begin = data;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        const char* end = i + 1 == chunk_count ? data_end : data + file.size * (i + 1) / chunk_count;
+        if (end < begin)
+            end = begin;
+
+        const char* newline = (const char*)memchr(end, '\n', data_end - end);
+        end = newline != nullptr ? newline + 1 : data_end;
+
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+        begin = end;
+    }
+
+    // The dummy elements go into the first chunk so its indices come out global without a fix-up
+    chunks[0].positions.push_back(Vector3Zeros);
+    chunks[0].tcoords.push_back(Vector2Zeros);
+    chunks[0].normals.push_back(Vector3UnitZ);
+
+    ParallelFor((int)chunk_count, [&chunks](int i) { ParseChunk(&chunks[i]); });
+
+    // Prefix sums give each chunk its place in the merged arrays
+    std::vector<size_t> position_bases(chunk_count), tcoord_bases(chunk_count), normal_bases(chunk_count);
+    std::vector<size_t> index_bases(chunk_count), face_bases(chunk_count);
+    for (size_t i = 1; i < chunk_count; i++)
+    {
+        position_bases[i] = position_bases[i - 1] + chunks[i - 1].positions.size();
+        tcoord_bases[i] = tcoord_bases[i - 1] + chunks[i - 1].tcoords.size();
+        normal_bases[i] = normal_bases[i - 1] + chunks[i - 1].normals.size();
+        index_bases[i] = index_bases[i - 1] + chunks[i - 1].indices.size();
+        face_bases[i] = face_bases[i - 1] + chunks[i - 1].face_vertices.size();
+    }
+
+    const uint32_t counts[3] =
+    {
+        (uint32_t)(position_bases.back() + chunks.back().positions.size()),
+        (uint32_t)(tcoord_bases.back() + chunks.back().tcoords.size()),
+        (uint32_t)(normal_bases.back() + chunks.back().normals.size())
+    };
+
+    // Relative index fix-up: local count + offset becomes global once we know how much came before each chunk
+    std::vector<int> invalid(chunk_count, 0);
+    ParallelFor((int)chunk_count, [&](int i)
+    {
+        ObjChunk& chunk = chunks[i];
+        const uint32_t bases[3] = { (uint32_t)position_bases[i], (uint32_t)tcoord_bases[i], (uint32_t)normal_bases[i] };
+        uint32_t* values = &chunk.indices.data()->p;
+        for (uint32_t slot : chunk.relative_indices)
+            values[slot] += bases[slot % 3];
+
+        for (ObjIndex& index : chunk.indices)
+        {
+            uint32_t* value = &index.p;
+            for (int k = 0; k < 3; k++)
+            {
+                if (value[k] >= counts[k])
+                {
+                    value[k] = 0;
+                    invalid[i]++;
+                }
+            }
+        }
+    });
+
+    MergeChunks(&obj->positions, chunks, &ObjChunk::positions, position_bases);
+    MergeChunks(&obj->tcoords, chunks, &ObjChunk::tcoords, tcoord_bases);
+    MergeChunks(&obj->normals, chunks, &ObjChunk::normals, normal_bases);
+    MergeChunks(&obj->indices, chunks, &ObjChunk::indices, index_bases);
+    MergeChunks(&obj->face_vertices, chunks, &ObjChunk::face_vertices, face_bases);
+
+    UnmapFile(&file);
+
+    int invalid_count = 0;
+    for (int count : invalid)
+        invalid_count += count;
+    if (invalid_count > 0)
+        printf("Warning: %s has %i out of range indices\n", path, invalid_count);
+
+    return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "raymath.h"
+
+// Same layout as fastObjIndex, 0 means the corner doesn't reference that attribute
+struct ObjIndex
+{
+    uint32_t p;
+    uint32_t t;
+    uint32_t n;
+};
+
+// Attribute arrays follow fast_obj's convention:
+// element 0 is a dummy so the obj file's 1-based indices can be used directly.
+struct ObjMesh
+{
+    std::vector<Vector3> positions;
+    std::vector<Vector2> tcoords;
+    std::vector<Vector3> normals;
+
+    std::vector<ObjIndex> indices;          // Every face corner
+    std::vector<uint32_t> face_vertices;    // Corners per face
+};
+
+// Memory-maps path and parses it in line-aligned chunks across the job threads.
+// Only geometry is read (v, vt, vn & f), materials and groups are ignored.
+bool ParseObjParallel(ObjMesh* obj, const char* path);
@@ -0,0 +1,185 @@
+#include "RenderQueue.h"
+#include "Shader.h"
+#include "Uniforms.h"
+#include <algorithm>
+#include <cassert>
+
+#define RENDER_KEY_NAME_MASK ((1ull << RENDER_KEY_NAME_BITS) - 1)
+#define RENDER_KEY_DEPTH_MAX ((1u << RENDER_KEY_DEPTH_BITS) - 1)
+
+uint64_t RenderKey(RenderLayer layer, GLuint program, GLuint texture, GLuint vao, float depth, float depth_range)
+{
+    static_assert(RENDER_KEY_LAYER_BITS + 3 * RENDER_KEY_NAME_BITS + RENDER_KEY_DEPTH_BITS == 64, "Render key fields must fill 64 bits");
+    assert(layer < (1 << RENDER_KEY_LAYER_BITS));
+
+    float t = std::min(std::max(depth / depth_range, 0.0f), 1.0f);
+    uint64_t quantized_depth = (uint64_t)(t * RENDER_KEY_DEPTH_MAX);
+
+    uint64_t state = ((program & RENDER_KEY_NAME_MASK) << (2 * RENDER_KEY_NAME_BITS)) |
+        ((texture & RENDER_KEY_NAME_MASK) << RENDER_KEY_NAME_BITS) | (vao & RENDER_KEY_NAME_MASK);
+
+    uint64_t key = (uint64_t)layer << (64 - RENDER_KEY_LAYER_BITS);
+    if (layer == RENDER_LAYER_TRANSPARENT)
+        key |= ((RENDER_KEY_DEPTH_MAX - quantized_depth) << (3 * RENDER_KEY_NAME_BITS)) | state;
+    else
+        key |= (state << RENDER_KEY_DEPTH_BITS) | quantized_depth;
+    return key;
+}
+
+void ClearRenderQueue(RenderQueue* queue, float depth_range)
+{
+    assert(depth_range > 0.0f);
+    queue->commands.clear();
+    queue->entries.clear();
+    queue->depth_range = depth_range;
+}
+
+static uint64_t RenderCommandKey(RenderLayer layer, const RenderCommand& command, float depth, float depth_range)
+{
+    assert(command.program != GL_NONE && command.mesh != nullptr);
+    GLuint texture = command.texture != nullptr ? command.texture->handle : GL_NONE;
+    return RenderKey(layer, command.program, texture, command.mesh->vao, depth, depth_range);
+}
+
+void SubmitRenderCommand(RenderQueue* queue, RenderLayer layer, const RenderCommand& command, float depth)
+{
+    RenderQueueEntry entry;
+    entry.key = RenderCommandKey(layer, command, depth, queue->depth_range);
+    entry.command = (uint32_t)queue->commands.size();
+    queue->entries.push_back(entry);
+    queue->commands.push_back(command);
+}
+
+void ClearRenderCommandBuffer(RenderCommandBuffer* buffer, float depth_range)
+{
+    assert(depth_range > 0.0f);
+    buffer->commands.clear();
+    buffer->keys.clear();
+    buffer->depth_range = depth_range;
+}
+
+void RecordRenderCommand(RenderCommandBuffer* buffer, RenderLayer layer, const RenderCommand& command, float depth)
+{
+    buffer->keys.push_back(RenderCommandKey(layer, command, depth, buffer->depth_range));
+    buffer->commands.push_back(command);
+}
+
+void MergeRenderCommandBuffers(RenderQueue* queue, const RenderCommandBuffer* buffers, int count)
+{
+    size_t total = queue->commands.size();
+    for (int i = 0; i < count; i++)
+        total += buffers[i].commands.size();
+    queue->commands.reserve(total);
+    queue->entries.reserve(total);
+
+    for (int i = 0; i < count; i++)
+    {
+        const RenderCommandBuffer& buffer = buffers[i];
+        assert(buffer.depth_range == queue->depth_range);
+        for (size_t j = 0; j < buffer.commands.size(); j++)
+        {
+            RenderQueueEntry entry;
+            entry.key = buffer.keys[j];
+            entry.command = (uint32_t)queue->commands.size();
+            queue->entries.push_back(entry);
+            queue->commands.push_back(buffer.commands[j]);
+        }
+    }
+}
+
+void SortRenderQueue(RenderQueue* queue)
+{
+    size_t count = queue->entries.size();
+    if (count < 2)
+        return;
+
+    // Histogram every byte in one pass over the keys
+    uint32_t histograms[8][256] = {};
+    for (const RenderQueueEntry& entry : queue->entries)
+    {
+        for (int pass = 0; pass < 8; pass++)
+            histograms[pass][(entry.key >> (pass * 8)) & 0xFF]++;
+    }
+
+    queue->scratch.resize(count);
+    RenderQueueEntry* source = queue->entries.data();
+    RenderQueueEntry* destination = queue->scratch.data();
+    for (int pass = 0; pass < 8; pass++)
+    {
+        // Most fields only use a few values, a byte every key shares wouldn't move anything
+        int shift = pass * 8;
+        uint32_t* histogram = histograms[pass];
+        if (histogram[(source[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for (int digit = 0; digit < 256; digit++)
+        {
+            offsets[digit] = sum;
+            sum += histogram[digit];
+        }
+
+        // Stable, so lower bytes sorted by earlier passes stay in order
+        for (size_t i = 0; i < count; i++)
+            destination[offsets[(source[i].key >> shift) & 0xFF]++] = source[i];
+        std::swap(source, destination);
+    }
+
+    if (source != queue->entries.data())
+        queue->entries.swap(queue->scratch);
+}
+
+void ExecuteRenderQueue(RenderQueue* queue)
+{
+    RenderQueueStats stats;
+    stats.commands = (int)queue->entries.size();
+    if (queue->entries.empty())
+    {
+        queue->stats = stats;
+        return;
+    }
+
+    ObjectUniformBlocks objects;
+    AllocateObjectUniforms((int)queue->entries.size(), &objects);
+    for (size_t i = 0; i < queue->entries.size(); i++)
+    {
+        const RenderCommand& command = queue->commands[queue->entries[i].command];
+        SetObjectUniforms(ObjectUniformsAt(&objects, (int)i), *command.mesh, command.world);
+    }
+    FinishObjectUniforms(&objects);
+
+    GLuint program = GL_NONE;
+    const Texture* texture = nullptr;
+    for (size_t i = 0; i < queue->entries.size(); i++)
+    {
+        const RenderCommand& command = queue->commands[queue->entries[i].command];
+        if (command.program != program)
+        {
+            if (program != GL_NONE)
+                EndShader();
+            BeginShader(command.program);
+            program = command.program;
+            stats.program_switches++;
+        }
+
+        if (command.texture != texture)
+        {
+            if (texture != nullptr)
+                EndTexture();
+            if (command.texture != nullptr)
+                BeginTexture(*command.texture);
+            texture = command.texture;
+            stats.texture_switches++;
+        }
+
+        BindObjectUniforms(objects, (int)i);
+        DrawMeshLod(*command.mesh, command.lod);
+    }
+
+    if (texture != nullptr)
+        EndTexture();
+    if (program != GL_NONE)
+        EndShader();
+    queue->stats = stats;
+}
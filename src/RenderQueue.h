@@ -0,0 +1,86 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+#include "Mesh.h"
+#include "Texture.h"
+
+// Layers draw in order. Opaque draws are grouped by program, texture & vertex array, then go front-to-back so
+// early depth testing rejects what's hidden. Transparent draws have to blend back-to-front, so distance comes first.
+enum RenderLayer
+{
+    RENDER_LAYER_OPAQUE,
+    RENDER_LAYER_TRANSPARENT,
+    RENDER_LAYER_COUNT
+};
+
+// Sort key, most significant bits first:
+// opaque:      layer 4 | program 12 | texture 12 | vertex array 12 | depth 24
+// transparent: layer 4 | inverted depth 24 | program 12 | texture 12 | vertex array 12
+// GL names are masked to 12 bits, so if two ever collide their draws just aren't grouped as tightly
+#define RENDER_KEY_LAYER_BITS 4
+#define RENDER_KEY_NAME_BITS 12
+#define RENDER_KEY_DEPTH_BITS 24
+
+// What it takes to issue one draw, the key only decides when
+struct RenderCommand
+{
+    GLuint program = GL_NONE;
+    const Texture* texture = nullptr;   // nullptr for untextured programs
+    const Mesh* mesh = nullptr;
+    int lod = 0;
+    Matrix world;                       // View & projection come from the frame uniform block
+};
+
+struct RenderQueueEntry
+{
+    uint64_t key;
+    uint32_t command;       // Index into RenderQueue::commands
+};
+
+// Draws recorded away from the GL thread: plain data only, so any thread can fill one.
+// Give each job its own buffer and recording needs no locks, then merge them into the queue on the GL thread.
+struct RenderCommandBuffer
+{
+    std::vector<RenderCommand> commands;
+    std::vector<uint64_t> keys;
+    float depth_range = 1.0f;
+};
+
+struct RenderQueueStats
+{
+    int commands = 0;
+    int program_switches = 0;
+    int texture_switches = 0;
+};
+
+struct RenderQueue
+{
+    std::vector<RenderCommand> commands;
+    std::vector<RenderQueueEntry> entries;
+    std::vector<RenderQueueEntry> scratch;  // Radix sort ping-pong buffer
+    float depth_range = 1.0f;               // Distances are quantized over [0, depth_range]
+    RenderQueueStats stats;                 // Of the last ExecuteRenderQueue
+};
+
+// Forget last frame's commands, depth_range is usually the far plane
+void ClearRenderQueue(RenderQueue* queue, float depth_range);
+
+// depth is the distance from the camera to the draw
+void SubmitRenderCommand(RenderQueue* queue, RenderLayer layer, const RenderCommand& command, float depth);
+
+void ClearRenderCommandBuffer(RenderCommandBuffer* buffer, float depth_range);
+void RecordRenderCommand(RenderCommandBuffer* buffer, RenderLayer layer, const RenderCommand& command, float depth);
+
+// Appends the buffers' draws to the queue in buffer order, so the result doesn't depend on which thread recorded what
+void MergeRenderCommandBuffers(RenderQueue* queue, const RenderCommandBuffer* buffers, int count);
+
+// Radix sorts the submitted draws by key (8 passes of 8 bits, skipping bytes every key shares)
+void SortRenderQueue(RenderQueue* queue);
+
+// Issues the draws in sorted order, switching program & texture only when they change.
+// Each draw's world matrix & mesh dequantization go in an Object uniform block (see Uniforms.h),
+// all written up front so per draw there's only a buffer range to bind.
+void ExecuteRenderQueue(RenderQueue* queue);
+
+uint64_t RenderKey(RenderLayer layer, GLuint program, GLuint texture, GLuint vao, float depth, float depth_range);
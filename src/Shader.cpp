@@ -1,17 +1,66 @@
 #include "Shader.h"
+#include "ShaderCache.h"
+#include "File.h"
+#include "StateCache.h"
+#include "Window.h"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+struct UniformSlot
+{
+    uint32_t hash = 0;
+    GLint location = -1;    // -1 for names we've reported missing
+    bool used = false;
+};
+
+// Everything we know about a linked program, built once by LoadProgramInfo
+struct ProgramInfo
+{
+    ProgramReflection reflection;
+
+    // Name hash to location, open-addressed with a power of 2 size that's never more than half full
+    std::vector<UniformSlot> slots;
+    int count = 0;
+
+    // Location of each registered Uniform handle, by index (-1 if the program doesn't declare it)
+    std::vector<GLint> handle_locations;
+};
+
+struct RegisteredUniform
+{
+    std::string name;
+    GLenum type;
+};
+
+// From KHR_parallel_shader_compile, which our glad doesn't include
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
 static GLuint f_shader = GL_NONE;
+static ProgramInfo* f_program_info = nullptr;      // The bound shader's
+static std::unordered_map<GLuint, ProgramInfo> f_program_infos;
 
-int GetUniformLocation(GLuint shader, const char* name);
+static GLint GetUniformLocation(UniformName name);
+static ProgramInfo* LoadProgramInfo(GLuint program);
 
-GLuint CreateShader(GLint type, const char* path)
+// Function-local so handles registered during static initialization of other files find it constructed
+static std::vector<RegisteredUniform>& RegisteredUniforms()
+{
+    static std::vector<RegisteredUniform> uniforms;
+    return uniforms;
+}
+
+static bool ReadShaderFile(const char* path, std::string* source)
 {
-    GLuint shader = 0;
     try
     {
         // Load text file
@@ -23,48 +72,153 @@ GLuint CreateShader(GLint type, const char* path)
         std::stringstream stream;
         stream << file.rdbuf();
         file.close();
+        *source = stream.str();
+        return true;
+    }
+    catch (std::ifstream::failure& e)
+    {
+        std::cout << "Shader (" << path << ") not found: " << e.what() << std::endl;
+        return false;
+    }
+}
 
-        // Verify shader type matches shader file extension
-        const char* ext = strrchr(path, '.');
-        switch (type)
-        {
-        case GL_VERTEX_SHADER:
-            assert(strcmp(ext, ".vert") == 0);
-            break;
+// Appends path's text with each #include "file" (relative to the including file) replaced by that file's text.
+// A file is only included once per stage, its index in included is its #line source string number.
+// Every file read goes in files (with its modified time) for hot reload.
+static bool AppendShaderFile(const std::string& path, std::string* source, std::vector<std::string>* included, std::vector<ShaderFile>* files)
+{
+    if (std::find(included->begin(), included->end(), path) != included->end())
+        return true;
+    std::string index = std::to_string(included->size());
+    included->push_back(path);
 
-        case GL_FRAGMENT_SHADER:
-            assert(strcmp(ext, ".frag") == 0);
-            break;
-        default:
-            assert(false, "Invalid shader type");
-            break;
+    ShaderFile file;
+    file.path = path;
+    uint64_t size;
+    FileInfo(path.c_str(), &size, &file.mtime);
+    auto watched = std::find_if(files->begin(), files->end(), [&](const ShaderFile& other) { return other.path == path; });
+    if (watched == files->end())
+        files->push_back(file);
+
+    std::string text;
+    if (!ReadShaderFile(path.c_str(), &text))
+        return false;
+
+    size_t slash = path.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+    std::istringstream lines(text);
+    std::string line;
+    int number = 0;
+    while (std::getline(lines, line))
+    {
+        number++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+        {
+            *source += line;
+            *source += '\n';
+            continue;
         }
 
-        // Compile text as a shader
-        std::string str = stream.str();
-        const char* src = str.c_str();
-        shader = glCreateShader(type);
-        glShaderSource(shader, 1, &src, NULL);
-        glCompileShader(shader);
-
-        // Check for compilation errors
-        GLint success;
-        GLchar infoLog[512];
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-        if (!success)
+        size_t open = line.find('"', start);
+        size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+        if (close == std::string::npos)
         {
-            glGetShaderInfoLog(shader, 512, NULL, infoLog);
-            std::cout << "Shader failed to compile: \n" << infoLog << std::endl;
+            printf("Warning: %s(%i) has a malformed #include\n", path.c_str(), number);
+            return false;
         }
+
+        // #line keeps compile errors pointing at the right line & file (the include gets the next source string number)
+        *source += "#line 1 " + std::to_string(included->size()) + "\n";
+        if (!AppendShaderFile(directory + line.substr(open + 1, close - open - 1), source, included, files))
+            return false;
+        *source += "#line " + std::to_string(number + 1) + " " + index + "\n";
     }
-    catch (std::ifstream::failure& e)
+    return true;
+}
+
+// path's text with its includes expanded and defines inserted after the #version line.
+// included gets the stage's files by source string number (path is 0), for making sense of compile errors.
+static bool LoadShaderSource(const std::string& path, const std::string& defines, std::string* source,
+    std::vector<std::string>* included, std::vector<ShaderFile>* files)
+{
+    std::string text;
+    included->clear();
+    if (!AppendShaderFile(path, &text, included, files))
+        return false;
+
+    size_t version_end = 0;
+    if (text.compare(0, 8, "#version") == 0)
+        version_end = text.find('\n') + 1;
+
+    *source = text.substr(0, version_end) + defines;
+    if (!defines.empty())
+        *source += "#line 2 0\n";
+    *source += text.substr(version_end);
+    return true;
+}
+
+// Queues the compile without waiting for it, see ReportShader
+static GLuint SubmitShader(GLint type, const std::string& source)
+{
+    const char* src = source.c_str();
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &src, NULL);
+    glCompileShader(shader);
+    return shader;
+}
+
+// Waits for the compile if it's still running. Errors are reported against source string numbers, included says which file each is.
+static bool ReportShader(GLuint shader, const std::vector<std::string>& included)
+{
+    // Check for compilation errors
+    GLint success;
+    GLchar infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
     {
-        std::cout << "Shader (" << path << ") not found: " << e.what() << std::endl;
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cout << "Shader failed to compile: \n" << infoLog << std::endl;
+        for (size_t i = 0; i < included.size(); i++)
+            std::cout << "  source " << i << ": " << included[i] << std::endl;
     }
+    return success == GL_TRUE;
+}
 
+static GLuint CompileShader(GLint type, const std::string& source, const std::vector<std::string>& included)
+{
+    GLuint shader = SubmitShader(type, source);
+    ReportShader(shader, included);
     return shader;
 }
 
+GLuint CreateShader(GLint type, const char* path)
+{
+    // Verify shader type matches shader file extension
+    const char* ext = strrchr(path, '.');
+    switch (type)
+    {
+    case GL_VERTEX_SHADER:
+        assert(strcmp(ext, ".vert") == 0);
+        break;
+
+    case GL_FRAGMENT_SHADER:
+        assert(strcmp(ext, ".frag") == 0);
+        break;
+    default:
+        assert(false, "Invalid shader type");
+        break;
+    }
+
+    std::string source;
+    std::vector<std::string> included;
+    std::vector<ShaderFile> files;
+    if (!LoadShaderSource(path, "", &source, &included, &files))
+        return 0;
+    return CompileShader(type, source, included);
+}
+
 void DestroyShader(GLuint* handle)
 {
     assert(*handle != GL_NONE);
@@ -77,6 +231,9 @@ GLuint CreateProgram(GLuint vs, GLuint fs)
     GLuint program = glCreateProgram();
     glAttachShader(program, vs);
     glAttachShader(program, fs);
+
+    // So LoadProgram can save the linked binary to the shader cache
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
 
     // Check for linking errors
@@ -88,13 +245,218 @@ GLuint CreateProgram(GLuint vs, GLuint fs)
         glGetProgramInfoLog(program, 512, NULL, infoLog);
         std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
     }
+    else
+    {
+        LoadProgramInfo(program);
+    }
 
     return program;
 }
 
+GLuint LoadProgram(const char* vs_path, const char* fs_path)
+{
+    std::string vs_source, fs_source;
+    std::vector<std::string> vs_included, fs_included;
+    std::vector<ShaderFile> files;
+    if (!LoadShaderSource(vs_path, "", &vs_source, &vs_included, &files) || !LoadShaderSource(fs_path, "", &fs_source, &fs_included, &files))
+        return GL_NONE;
+
+    uint64_t key = ProgramCacheKey(vs_source, fs_source);
+    GLuint program = LoadProgramCache(key);
+    if (program != GL_NONE)
+    {
+        LoadProgramInfo(program);
+        return program;
+    }
+
+    GLuint vs = CompileShader(GL_VERTEX_SHADER, vs_source, vs_included);
+    GLuint fs = CompileShader(GL_FRAGMENT_SHADER, fs_source, fs_included);
+    program = CreateProgram(vs, fs);
+    DestroyShader(&vs);
+    DestroyShader(&fs);
+
+    if (program != GL_NONE)
+        SaveProgramCache(program, key);
+    return program;
+}
+
+static void SetReadyProgram(AsyncProgram* program, GLuint linked)
+{
+    if (program->program != GL_NONE)
+        DestroyProgram(&program->program);
+    program->program = linked;
+}
+
+static void CancelProgramLink(AsyncProgram* program)
+{
+    if (program->pending == GL_NONE)
+        return;
+
+    glDeleteProgram(program->pending);
+    DestroyShader(&program->pending_vs);
+    DestroyShader(&program->pending_fs);
+    program->pending = GL_NONE;
+}
+
+static bool SourcesModified(const AsyncProgram& program)
+{
+    for (const ShaderFile& file : program.files)
+    {
+        uint64_t size, mtime = 0;
+        FileInfo(file.path.c_str(), &size, &mtime);
+        if (mtime != file.mtime)
+            return true;
+    }
+    return false;
+}
+
+// Returns true if the program was in the shader cache and is ready now, otherwise it's left linking in the background
+static bool StartProgramLink(AsyncProgram* program)
+{
+    CancelProgramLink(program);
+
+    // Files that couldn't be read stay watched (at modified time 0), so fixing them restarts the link
+    std::string vs_source, fs_source;
+    program->files.clear();
+    if (!LoadShaderSource(program->vs_path, program->defines, &vs_source, &program->vs_included, &program->files) ||
+        !LoadShaderSource(program->fs_path, program->defines, &fs_source, &program->fs_included, &program->files))
+        return false;
+
+    uint64_t key = ProgramCacheKey(vs_source, fs_source);
+    GLuint cached = LoadProgramCache(key);
+    if (cached != GL_NONE)
+    {
+        LoadProgramInfo(cached);
+        SetReadyProgram(program, cached);
+        return true;
+    }
+
+    // Nothing here waits on the compiler: status is only queried once the link reports completion
+    program->pending_vs = SubmitShader(GL_VERTEX_SHADER, vs_source);
+    program->pending_fs = SubmitShader(GL_FRAGMENT_SHADER, fs_source);
+    program->pending = glCreateProgram();
+    program->pending_key = key;
+    glAttachShader(program->pending, program->pending_vs);
+    glAttachShader(program->pending, program->pending_fs);
+    glProgramParameteri(program->pending, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program->pending);
+    return false;
+}
+
+static bool FinishProgramLink(AsyncProgram* program)
+{
+    GLint success;
+    glGetProgramiv(program->pending, GL_LINK_STATUS, &success);
+    if (success)
+    {
+        GLuint linked = program->pending;
+        program->pending = GL_NONE;
+        DestroyShader(&program->pending_vs);
+        DestroyShader(&program->pending_fs);
+
+        LoadProgramInfo(linked);
+        SaveProgramCache(linked, program->pending_key);
+        SetReadyProgram(program, linked);
+        return true;
+    }
+
+    // Keep drawing with the last program that linked
+    char infoLog[512];
+    ReportShader(program->pending_vs, program->vs_included);
+    ReportShader(program->pending_fs, program->fs_included);
+    glGetProgramInfoLog(program->pending, 512, NULL, infoLog);
+    std::cout << "Program (" << program->vs_path << ", " << program->fs_path << ") failed to link: \n" << infoLog << std::endl;
+    CancelProgramLink(program);
+    return false;
+}
+
+void CreateAsyncProgram(AsyncProgram* program, const char* vs_path, const char* fs_path, const char* defines)
+{
+    assert(program->program == GL_NONE && program->pending == GL_NONE);
+    program->vs_path = vs_path;
+    program->fs_path = fs_path;
+    program->defines = defines;
+    StartProgramLink(program);
+}
+
+void DestroyAsyncProgram(AsyncProgram* program)
+{
+    CancelProgramLink(program);
+    if (program->program != GL_NONE)
+        DestroyProgram(&program->program);
+}
+
+bool UpdateAsyncProgram(AsyncProgram* program, bool check_files)
+{
+    assert(f_shader == GL_NONE);
+    bool ready = false;
+    if (check_files && SourcesModified(*program))
+    {
+        printf("Reloading %s & %s%s\n", program->vs_path.c_str(), program->fs_path.c_str(), program->defines.empty() ? "" : " (variant)");
+        ready = StartProgramLink(program);
+    }
+
+    if (program->pending == GL_NONE)
+        return ready;
+
+    // Without the extension, the status query below blocks until the driver is done
+    if (HasParallelShaderCompile())
+    {
+        GLint complete = GL_FALSE;
+        glGetProgramiv(program->pending, GL_COMPLETION_STATUS_KHR, &complete);
+        if (!complete)
+            return ready;
+    }
+    return FinishProgramLink(program);
+}
+
+void CreateShaderVariants(ShaderVariants* variants, const char* vs_path, const char* fs_path,
+    const char* const* features, int feature_count, const uint32_t* masks, int mask_count)
+{
+    assert(feature_count >= 0 && feature_count <= SHADER_VARIANT_MAX_FEATURES);
+    variants->features.assign(features, features + feature_count);
+    variants->programs.assign(1u << feature_count, AsyncProgram());
+
+    // Every link is submitted before any is waited on, so the driver compiles them side by side
+    for (int i = 0; i < mask_count; i++)
+    {
+        uint32_t mask = masks[i];
+        assert(mask < variants->programs.size());
+        std::string defines;
+        for (int feature = 0; feature < feature_count; feature++)
+        {
+            if (mask & (1u << feature))
+                defines += "#define " + variants->features[feature] + "\n";
+        }
+        CreateAsyncProgram(&variants->programs[mask], vs_path, fs_path, defines.c_str());
+    }
+}
+
+void DestroyShaderVariants(ShaderVariants* variants)
+{
+    for (AsyncProgram& program : variants->programs)
+        DestroyAsyncProgram(&program);
+    variants->programs.clear();
+}
+
+bool UpdateShaderVariants(ShaderVariants* variants, bool check_files)
+{
+    bool ready = false;
+    for (AsyncProgram& program : variants->programs)
+    {
+        if (!program.vs_path.empty())
+            ready |= UpdateAsyncProgram(&program, check_files);
+    }
+    return ready;
+}
+
 void DestroyProgram(GLuint* handle)
 {
-    assert(*handle != GL_NONE);
+    assert(*handle != GL_NONE && *handle != f_shader);
+
+    // A program in use is only deleted once it's no longer current
+    CacheUseProgram(GL_NONE);
+    f_program_infos.erase(*handle);
     glDeleteProgram(*handle);
     *handle = GL_NONE;
 }
@@ -102,48 +464,342 @@ void DestroyProgram(GLuint* handle)
 void BeginShader(GLuint shader)
 {
     assert(f_shader == GL_NONE);
-    glUseProgram(shader);
+    CacheUseProgram(shader);
     f_shader = shader;
+
+    // Programs linked without CreateProgram get their table on first use
+    auto table = f_program_infos.find(shader);
+    f_program_info = table != f_program_infos.end() ? &table->second : LoadProgramInfo(shader);
 }
 
 void EndShader()
 {
     assert(f_shader != GL_NONE);
-    glUseProgram(GL_NONE);
-    f_shader = GL_NONE;
+    f_shader = GL_NONE;     // Stays current in GL until another program is used
+    f_program_info = nullptr;
 }
 
-void SendInt(int value, const char* name)
+static UniformSlot* FindUniformSlot(ProgramInfo* table, uint32_t hash)
 {
-    int location = GetUniformLocation(f_shader, name);
-    glUniform1i(location, value);
+    // The table always has empty slots, so probing ends
+    uint32_t mask = (uint32_t)table->slots.size() - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        UniformSlot* slot = &table->slots[i];
+        if (!slot->used || slot->hash == hash)
+            return slot;
+    }
 }
 
-void SendFloat(float value, const char* name)
+static void InsertUniform(ProgramInfo* table, uint32_t hash, GLint location)
 {
-    int location = GetUniformLocation(f_shader, name);
-    glUniform1f(location, value);
+    if ((table->count + 1) * 2 > (int)table->slots.size())
+    {
+        std::vector<UniformSlot> slots(table->slots.size() * 2);
+        slots.swap(table->slots);
+        for (const UniformSlot& slot : slots)
+        {
+            if (slot.used)
+                *FindUniformSlot(table, slot.hash) = slot;
+        }
+    }
+
+    UniformSlot* slot = FindUniformSlot(table, hash);
+    table->count += slot->used ? 0 : 1;
+    slot->hash = hash;
+    slot->location = location;
+    slot->used = true;
 }
 
-void SendVec2(Vector2 value, const char* name)
+static std::string ProgramResourceName(GLuint program, GLenum interface, GLint index, GLint length)
 {
-    int location = GetUniformLocation(f_shader, name);
-    glUniform2f(location, value.x, value.y);
+    std::vector<char> name(std::max(length, 1));
+    glGetProgramResourceName(program, interface, index, (GLsizei)name.size(), nullptr, name.data());
+    return name.data();
 }
 
-void SendVec3(Vector3 value, const char* name)
+static void ReflectProgram(GLuint program, ProgramReflection* reflection)
 {
-    int location = GetUniformLocation(f_shader, name);
-    glUniform3f(location, value.x, value.y, value.z);
+    GLint count = 0;
+    glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const GLenum properties[] = { GL_NAME_LENGTH, GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE, GL_BLOCK_INDEX };
+        GLint values[5] = {};
+        glGetProgramResourceiv(program, GL_UNIFORM, i, 5, properties, 5, nullptr, values);
+
+        ProgramUniform uniform;
+        uniform.name = ProgramResourceName(program, GL_UNIFORM, i, values[0]);
+        uniform.type = (GLenum)values[1];
+        uniform.location = values[2];
+        uniform.array_size = values[3];
+        uniform.block = values[4];
+        reflection->uniforms.push_back(uniform);
+    }
+
+    glGetProgramInterfaceiv(program, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const GLenum properties[] = { GL_NAME_LENGTH, GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+        GLint values[3] = {};
+        glGetProgramResourceiv(program, GL_UNIFORM_BLOCK, i, 3, properties, 3, nullptr, values);
+
+        ProgramUniformBlock block;
+        block.name = ProgramResourceName(program, GL_UNIFORM_BLOCK, i, values[0]);
+        block.binding = values[1];
+        block.size = values[2];
+        reflection->blocks.push_back(block);
+    }
+
+    glGetProgramInterfaceiv(program, GL_PROGRAM_INPUT, GL_ACTIVE_RESOURCES, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const GLenum properties[] = { GL_NAME_LENGTH, GL_TYPE, GL_LOCATION };
+        GLint values[3] = {};
+        glGetProgramResourceiv(program, GL_PROGRAM_INPUT, i, 3, properties, 3, nullptr, values);
+
+        ProgramAttribute attribute;
+        attribute.name = ProgramResourceName(program, GL_PROGRAM_INPUT, i, values[0]);
+        attribute.type = (GLenum)values[1];
+        attribute.location = values[2];
+        reflection->attributes.push_back(attribute);
+    }
+}
+
+#ifndef NDEBUG
+// glUniform1i also sets bools & samplers
+static bool IsUniformTypeCompatible(GLenum declared, GLenum type)
+{
+    if (declared == type)
+        return true;
+
+    if (type != GL_INT)
+        return false;
+
+    switch (declared)
+    {
+    case GL_BOOL:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_CUBE_SHADOW:
+        return true;
+    default:
+        return false;
+    }
+}
+#endif
+
+// Locations of the handles registered since the program was loaded
+static void ResolveUniformHandles(GLuint program, ProgramInfo* info)
+{
+    const std::vector<RegisteredUniform>& registered = RegisteredUniforms();
+    for (size_t i = info->handle_locations.size(); i < registered.size(); i++)
+    {
+        // Arrays are listed as "name[0]", but set by their plain name
+        const std::string& name = registered[i].name;
+        std::string array_name = name + "[0]";
+
+        GLint location = -1;
+        for (const ProgramUniform& uniform : info->reflection.uniforms)
+        {
+            if (uniform.location == -1 || (uniform.name != name && uniform.name != array_name))
+                continue;
+
+            location = uniform.location;
+#ifndef NDEBUG
+            if (!IsUniformTypeCompatible(uniform.type, registered[i].type))
+            {
+                printf("Warning: shader %i declares uniform %s as type 0x%04X but it's set as 0x%04X, ignoring it\n",
+                    program, name.c_str(), uniform.type, registered[i].type);
+                location = -1;
+            }
+#endif
+            break;
+        }
+        info->handle_locations.push_back(location);
+    }
 }
 
-void SendVec4(Vector4 value, const char* name)
+static ProgramInfo* LoadProgramInfo(GLuint program)
 {
-    int location = GetUniformLocation(f_shader, name);
-    glUniform4f(location, value.x, value.y, value.z, value.w);
+    ProgramInfo* info = &f_program_infos[program];
+    *info = ProgramInfo();
+    info->slots.resize(16);
+    ReflectProgram(program, &info->reflection);
+
+    for (const ProgramUniform& uniform : info->reflection.uniforms)
+    {
+        // Uniform block members have no location
+        if (uniform.location == -1)
+            continue;
+
+        uint32_t hash = HashUniformName(uniform.name.c_str());
+        UniformSlot* slot = FindUniformSlot(info, hash);
+        if (slot->used)
+            printf("Warning: shader %i uniform %s shares a name hash with another uniform\n", program, uniform.name.c_str());
+        InsertUniform(info, hash, uniform.location);
+
+        // Arrays are listed as "name[0]", but sent to by their plain name
+        size_t bracket = uniform.name.rfind('[');
+        if (bracket != std::string::npos)
+            InsertUniform(info, HashUniformName(uniform.name.substr(0, bracket).c_str()), uniform.location);
+    }
+
+    ResolveUniformHandles(program, info);
+    return info;
 }
 
-void SendMat3(Matrix v, const char* name)
+const ProgramReflection* GetProgramReflection(GLuint program)
+{
+    auto info = f_program_infos.find(program);
+    return info != f_program_infos.end() ? &info->second.reflection : nullptr;
+}
+
+int RegisterUniform(const char* name, GLenum type)
+{
+    std::vector<RegisteredUniform>& uniforms = RegisteredUniforms();
+    for (size_t i = 0; i < uniforms.size(); i++)
+    {
+        if (uniforms[i].name == name)
+        {
+            assert(uniforms[i].type == type);
+            return (int)i;
+        }
+    }
+
+    RegisteredUniform uniform;
+    uniform.name = name;
+    uniform.type = type;
+    uniforms.push_back(uniform);
+    return (int)uniforms.size() - 1;
+}
+
+static GLint HandleLocation(int index)
+{
+    assert(f_program_info != nullptr && index >= 0);
+
+    // Handles registered after the bound program loaded (function-local statics, say) are resolved on first use
+    if (index >= (int)f_program_info->handle_locations.size())
+        ResolveUniformHandles(f_shader, f_program_info);
+    return f_program_info->handle_locations[index];
+}
+
+bool HasUniformHandle(int index)
+{
+    return HandleLocation(index) != -1;
+}
+
+void SetUniform(Uniform<int> uniform, int value)
+{
+    GLint location = HandleLocation(uniform.index);
+    if (HasDirectStateAccess())
+        glProgramUniform1i(f_shader, location, value);
+    else
+        glUniform1i(location, value);
+}
+
+void SetUniform(Uniform<float> uniform, float value)
+{
+    GLint location = HandleLocation(uniform.index);
+    if (HasDirectStateAccess())
+        glProgramUniform1f(f_shader, location, value);
+    else
+        glUniform1f(location, value);
+}
+
+void SetUniform(Uniform<Vector2> uniform, Vector2 value)
+{
+    GLint location = HandleLocation(uniform.index);
+    if (HasDirectStateAccess())
+        glProgramUniform2f(f_shader, location, value.x, value.y);
+    else
+        glUniform2f(location, value.x, value.y);
+}
+
+void SetUniform(Uniform<Vector3> uniform, Vector3 value)
+{
+    GLint location = HandleLocation(uniform.index);
+    if (HasDirectStateAccess())
+        glProgramUniform3f(f_shader, location, value.x, value.y, value.z);
+    else
+        glUniform3f(location, value.x, value.y, value.z);
+}
+
+void SetUniform(Uniform<Vector4> uniform, Vector4 value)
+{
+    GLint location = HandleLocation(uniform.index);
+    if (HasDirectStateAccess())
+        glProgramUniform4f(f_shader, location, value.x, value.y, value.z, value.w);
+    else
+        glUniform4f(location, value.x, value.y, value.z, value.w);
+}
+
+void SetUniform(Uniform<Matrix> uniform, Matrix value)
+{
+    GLint location = HandleLocation(uniform.index);
+    if (HasDirectStateAccess())
+        glProgramUniformMatrix4fv(f_shader, location, 1, GL_FALSE, MatrixToFloat(value));
+    else
+        glUniformMatrix4fv(location, 1, GL_FALSE, MatrixToFloat(value));
+}
+
+bool HasUniform(UniformName name)
+{
+    assert(f_program_info != nullptr);
+    const UniformSlot* slot = FindUniformSlot(f_program_info, name.hash);
+    return slot->used && slot->location != -1;
+}
+
+// With direct state access uniforms are written to the program object itself rather than through the bound program
+void SendInt(int value, UniformName name)
+{
+    int location = GetUniformLocation(name);
+    if (HasDirectStateAccess())
+        glProgramUniform1i(f_shader, location, value);
+    else
+        glUniform1i(location, value);
+}
+
+void SendFloat(float value, UniformName name)
+{
+    int location = GetUniformLocation(name);
+    if (HasDirectStateAccess())
+        glProgramUniform1f(f_shader, location, value);
+    else
+        glUniform1f(location, value);
+}
+
+void SendVec2(Vector2 value, UniformName name)
+{
+    int location = GetUniformLocation(name);
+    if (HasDirectStateAccess())
+        glProgramUniform2f(f_shader, location, value.x, value.y);
+    else
+        glUniform2f(location, value.x, value.y);
+}
+
+void SendVec3(Vector3 value, UniformName name)
+{
+    int location = GetUniformLocation(name);
+    if (HasDirectStateAccess())
+        glProgramUniform3f(f_shader, location, value.x, value.y, value.z);
+    else
+        glUniform3f(location, value.x, value.y, value.z);
+}
+
+void SendVec4(Vector4 value, UniformName name)
+{
+    int location = GetUniformLocation(name);
+    if (HasDirectStateAccess())
+        glProgramUniform4f(f_shader, location, value.x, value.y, value.z, value.w);
+    else
+        glUniform4f(location, value.x, value.y, value.z, value.w);
+}
+
+void SendMat3(Matrix v, UniformName name)
 {
     float arr[9] =
     {
@@ -152,23 +808,32 @@ void SendMat3(Matrix v, const char* name)
         v.m8, v.m9, v.m10
     };
 
-    int location = GetUniformLocation(f_shader, name);
-    glUniformMatrix3fv(location, 1, GL_FALSE, arr);
+    int location = GetUniformLocation(name);
+    if (HasDirectStateAccess())
+        glProgramUniformMatrix3fv(f_shader, location, 1, GL_FALSE, arr);
+    else
+        glUniformMatrix3fv(location, 1, GL_FALSE, arr);
 }
 
-void SendMat4(Matrix value, const char* name)
+void SendMat4(Matrix value, UniformName name)
 {
-    int location = GetUniformLocation(f_shader, name);
-    glUniformMatrix4fv(location, 1, GL_FALSE, MatrixToFloat(value));
+    int location = GetUniformLocation(name);
+    if (HasDirectStateAccess())
+        glProgramUniformMatrix4fv(f_shader, location, 1, GL_FALSE, MatrixToFloat(value));
+    else
+        glUniformMatrix4fv(location, 1, GL_FALSE, MatrixToFloat(value));
 }
 
-int GetUniformLocation(GLuint shader, const char* name)
+static GLint GetUniformLocation(UniformName name)
 {
-    GLint location = glGetUniformLocation(shader, name);
-    if (location == -1)
-    {
-        printf("Warning: shader %i failed to send uniform %s\n", shader, name);
-        //assert(false); <-- eventually we might send data to shaders that don't use it
-    }
-    return location;
+    assert(f_program_info != nullptr);
+    UniformSlot* slot = FindUniformSlot(f_program_info, name.hash);
+    if (slot->used)
+        return slot->location;
+
+    // Remember the miss so it's only reported once (GL ignores location -1)
+    printf("Warning: shader %i failed to send uniform %s\n", f_shader, name.name);
+    //assert(false); <-- eventually we might send data to shaders that don't use it
+    InsertUniform(f_program_info, name.hash, -1);
+    return -1;
 }
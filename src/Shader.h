@@ -1,22 +1,192 @@
 #pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
 #include <glad/glad.h>
 #include "raymath.h"
 
+// FNV-1a, constexpr so the compiler can hash names it knows at build time
+constexpr uint32_t HashUniformName(const char* name, uint32_t hash = 2166136261u)
+{
+    return *name == '\0' ? hash : HashUniformName(name + 1, (hash ^ (uint8_t)*name) * 16777619u);
+}
+
+// A uniform's name & hash. Uniform locations are looked up by hash in a table built when the program is linked.
+// The constructor is constexpr, not guaranteed compile-time: a literal converted implicitly at the call
+// (SendMat4(m, "u_mvp")) may be hashed on every call. Declare the names the Send functions use as constants
+// (static constexpr UniformName u_mvp = "u_mvp";) so the hash is computed by the compiler.
+struct UniformName
+{
+    const char* name;
+    uint32_t hash;
+
+    constexpr UniformName(const char* name) : name(name), hash(HashUniformName(name)) {}
+};
+
+// What a linked program declares, queried once when it's loaded (program interface queries)
+struct ProgramUniform
+{
+    std::string name;
+    GLenum type;
+    GLint location;         // -1 for uniform block members
+    GLint array_size;
+    GLint block;            // Uniform block index, -1 outside blocks
+};
+
+struct ProgramUniformBlock
+{
+    std::string name;
+    GLint binding;
+    GLint size;             // Bytes the buffer range bound to it must cover
+};
+
+struct ProgramAttribute
+{
+    std::string name;
+    GLenum type;
+    GLint location;
+};
+
+struct ProgramReflection
+{
+    std::vector<ProgramUniform> uniforms;
+    std::vector<ProgramUniformBlock> blocks;
+    std::vector<ProgramAttribute> attributes;
+};
+
+// A uniform set by index rather than name. Register each name once (a static is handy) and every program resolves
+// it to a location when loaded, so setting it is an array lookup on the bound program: no strings, hashing or GL queries.
+// Debug builds check the type it's set as against the program's declaration.
+template <typename T>
+struct Uniform
+{
+    int index = -1;
+};
+
+// The GL type a value is sent as (ints also set bools & samplers)
+inline GLenum UniformType(const int*) { return GL_INT; }
+inline GLenum UniformType(const float*) { return GL_FLOAT; }
+inline GLenum UniformType(const Vector2*) { return GL_FLOAT_VEC2; }
+inline GLenum UniformType(const Vector3*) { return GL_FLOAT_VEC3; }
+inline GLenum UniformType(const Vector4*) { return GL_FLOAT_VEC4; }
+inline GLenum UniformType(const Matrix*) { return GL_FLOAT_MAT4; }
+
+int RegisterUniform(const char* name, GLenum type);
+
+template <typename T>
+Uniform<T> RegisterUniform(const char* name)
+{
+    Uniform<T> uniform;
+    uniform.index = RegisterUniform(name, UniformType((const T*)nullptr));
+    return uniform;
+}
+
 GLuint CreateShader(GLint type, const char* path);
 void DestroyShader(GLuint* handle);
 
 GLuint CreateProgram(GLuint vs, GLuint fs);
+
+// Compiles & links the pair, or loads the binary a previous run linked from the same sources on the same driver
+GLuint LoadProgram(const char* vs_path, const char* fs_path);
 void DestroyProgram(GLuint* handle);
 
+// Shader sources may #include "file" relative to themselves, every file read is watched for edits
+struct ShaderFile
+{
+    std::string path;
+    uint64_t mtime = 0;
+};
+
+// A program compiled & linked without blocking (on the driver's threads with KHR_parallel_shader_compile),
+// then relinked the same way whenever its source files change. Draw with the last program that linked (or a fallback
+// until the first one has), so a slow compile or a broken edit never stalls or empties the frame.
+struct AsyncProgram
+{
+    std::string vs_path;
+    std::string fs_path;
+    GLuint program = GL_NONE;       // Last successful link, GL_NONE until the first finishes
+
+    GLuint pending = GL_NONE;       // Linking in the background
+    GLuint pending_vs = GL_NONE;
+    GLuint pending_fs = GL_NONE;
+    uint64_t pending_key = 0;       // Shader cache key of the pending sources
+
+    std::string defines;            // #define lines inserted after each stage's #version (see ShaderVariants)
+    std::vector<ShaderFile> files;  // Sources & includes the last link started from
+
+    // Each stage's files by #line source string number, which compile errors refer to them by
+    std::vector<std::string> vs_included;
+    std::vector<std::string> fs_included;
+};
+
+// Starts compiling, or loads the program straight from the shader cache
+void CreateAsyncProgram(AsyncProgram* program, const char* vs_path, const char* fs_path, const char* defines = "");
+void DestroyAsyncProgram(AsyncProgram* program);
+
+// Polls the background link and, if check_files, restarts it when either source file changed.
+// Returns true if a new program became ready (replacing the old one). Call outside BeginShader/EndShader.
+bool UpdateAsyncProgram(AsyncProgram* program, bool check_files);
+
+inline GLuint ReadyProgram(const AsyncProgram& program, GLuint fallback)
+{
+    return program.program != GL_NONE ? program.program : fallback;
+}
+
+#define SHADER_VARIANT_MAX_FEATURES 8
+
+// Permutations of one vertex & fragment shader pair. Bit i of a variant's mask #defines features[i] in both stages.
+// The table has a slot for every mask so draws pick their program by indexing, but only the masks asked for get compiled.
+struct ShaderVariants
+{
+    std::vector<std::string> features;
+    std::vector<AsyncProgram> programs;     // Indexed by mask
+};
+
+// Starts every requested variant linking at once (see CreateAsyncProgram)
+void CreateShaderVariants(ShaderVariants* variants, const char* vs_path, const char* fs_path,
+    const char* const* features, int feature_count, const uint32_t* masks, int mask_count);
+void DestroyShaderVariants(ShaderVariants* variants);
+
+// UpdateAsyncProgram for every requested variant, true if any became ready
+bool UpdateShaderVariants(ShaderVariants* variants, bool check_files);
+
+inline const AsyncProgram& GetShaderVariant(const ShaderVariants& variants, uint32_t mask)
+{
+    return variants.programs[mask];
+}
+
 void BeginShader(GLuint shader);
 void EndShader();
 
-void SendInt(int value, const char* name);
-void SendFloat(float value, const char* name);
+// nullptr for programs neither linked nor bound through this module yet
+const ProgramReflection* GetProgramReflection(GLuint program);
+
+// Uniform handles on the bound shader. Ones it doesn't declare are skipped.
+bool HasUniformHandle(int index);
+
+template <typename T>
+bool HasUniform(Uniform<T> uniform)
+{
+    return HasUniformHandle(uniform.index);
+}
+
+void SetUniform(Uniform<int> uniform, int value);
+void SetUniform(Uniform<float> uniform, float value);
+void SetUniform(Uniform<Vector2> uniform, Vector2 value);
+void SetUniform(Uniform<Vector3> uniform, Vector3 value);
+void SetUniform(Uniform<Vector4> uniform, Vector4 value);
+void SetUniform(Uniform<Matrix> uniform, Matrix value);
+
+// Unlike the Send functions this doesn't warn, for uniforms only some shaders use (or the compiler optimized out)
+bool HasUniform(UniformName name);
+
+// By name, for one-off uniforms (hot loops should use handles). Uniforms the bound shader doesn't have are reported once, then skipped.
+void SendInt(int value, UniformName name);
+void SendFloat(float value, UniformName name);
 
-void SendVec2(Vector2 value, const char* name);
-void SendVec3(Vector3 value, const char* name);
-void SendVec4(Vector4 value, const char* name);
+void SendVec2(Vector2 value, UniformName name);
+void SendVec3(Vector3 value, UniformName name);
+void SendVec4(Vector4 value, UniformName name);
 
-void SendMat3(Matrix value, const char* name);
-void SendMat4(Matrix value, const char* name);
+void SendMat3(Matrix value, UniformName name);
+void SendMat4(Matrix value, UniformName name);
@@ -0,0 +1,134 @@
+#include "ShaderCache.h"
+#include "File.h"
+#include <cstdio>
+#include <vector>
+
+#define SHADER_CACHE_MAGIC 0x4D475250u // "PRGM"
+
+struct ShaderCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;        // Binary format glGetProgramBinary reported
+    uint32_t size;          // Bytes of binary following the header
+};
+
+static std::string CachePath(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.program", (unsigned long long)key);
+    return std::string(SHADER_CACHE_DIRECTORY) + "/" + name;
+}
+
+static bool HasProgramBinaryFormats()
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+    return count > 0;
+}
+
+uint64_t ProgramCacheKey(const std::string& vs_source, const std::string& fs_source)
+{
+    uint64_t hash = HashString(vs_source.c_str());
+    hash = HashString(fs_source.c_str(), hash);
+    hash = HashString((const char*)glGetString(GL_VENDOR), hash);
+    hash = HashString((const char*)glGetString(GL_RENDERER), hash);
+    hash = HashString((const char*)glGetString(GL_VERSION), hash);
+
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+    if (count > 0)
+    {
+        std::vector<GLint> formats(count);
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+        hash = HashBytes(formats.data(), formats.size() * sizeof(GLint), hash);
+    }
+    return hash;
+}
+
+GLuint LoadProgramCache(uint64_t key)
+{
+    if (!HasProgramBinaryFormats())
+        return GL_NONE;
+
+    MappedFile file;
+    if (!MapFile(&file, CachePath(key).c_str()))
+        return GL_NONE;
+
+    const ShaderCacheHeader* header = reinterpret_cast<const ShaderCacheHeader*>(file.data);
+    bool valid =
+        file.size >= sizeof(ShaderCacheHeader) &&
+        header->magic == SHADER_CACHE_MAGIC &&
+        header->version == SHADER_CACHE_VERSION &&
+        header->key == key &&
+        header->size > 0 &&
+        sizeof(ShaderCacheHeader) + header->size <= file.size;
+
+    GLuint program = GL_NONE;
+    if (valid)
+    {
+        // Drivers may still refuse a binary (after an update that kept the version string, for example)
+        program = glCreateProgram();
+        glProgramBinary(program, header->format, file.data + sizeof(ShaderCacheHeader), header->size);
+
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            printf("Program cache %016llx was rejected by the driver, recompiling\n", (unsigned long long)key);
+            glDeleteProgram(program);
+            program = GL_NONE;
+        }
+    }
+
+    UnmapFile(&file);
+    return program;
+}
+
+void SaveProgramCache(GLuint program, uint64_t key)
+{
+    if (!HasProgramBinaryFormats())
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    ShaderCacheHeader header{};
+    header.magic = SHADER_CACHE_MAGIC;
+    header.version = SHADER_CACHE_VERSION;
+    header.key = key;
+
+    std::vector<uint8_t> binary(length);
+    GLenum format = GL_NONE;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    header.format = format;
+    header.size = (uint32_t)length;
+
+    if (!MakeDirectory(SHADER_CACHE_DIRECTORY))
+    {
+        printf("Warning: could not create shader cache directory %s\n", SHADER_CACHE_DIRECTORY);
+        return;
+    }
+
+    std::string cache_path = CachePath(key);
+    FILE* file = fopen(cache_path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        printf("Warning: could not write shader cache %s\n", cache_path.c_str());
+        return;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(binary.data(), 1, header.size, file);
+    bool failed = ferror(file) != 0;
+    fclose(file);
+
+    if (failed)
+    {
+        printf("Warning: failed writing shader cache %s\n", cache_path.c_str());
+        remove(cache_path.c_str());
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+
+// Linked program binaries (glGetProgramBinary) cached on disk so later runs skip compiling & linking.
+// Cache files live next to the mesh cache and are keyed on the shader sources and the driver that built them,
+// since binaries only load on the exact driver that produced them.
+// Bump SHADER_CACHE_VERSION whenever the file layout changes!
+#define SHADER_CACHE_DIRECTORY "./assets/cache"
+#define SHADER_CACHE_VERSION 1
+
+// Hash of the sources, GL vendor, renderer & version and the binary formats the driver supports
+uint64_t ProgramCacheKey(const std::string& vs_source, const std::string& fs_source);
+
+// Returns a linked program or GL_NONE if the cache is missing or the driver rejects the binary
+GLuint LoadProgramCache(uint64_t key);
+
+// Writes program's binary (it must be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set)
+void SaveProgramCache(GLuint program, uint64_t key);
@@ -0,0 +1,74 @@
+#include "StateCache.h"
+#include "Window.h"
+
+static GLuint f_gl_vao = GL_NONE;
+static GLuint f_gl_program = GL_NONE;
+static GLuint f_gl_texture = GL_NONE;
+
+static StateCacheStats f_stats;
+static StateCacheStats f_last_stats;
+
+void CacheBindVertexArray(GLuint vao)
+{
+    if (vao == f_gl_vao)
+    {
+        f_stats.vertex_arrays.filtered++;
+        return;
+    }
+
+    glBindVertexArray(vao);
+    f_gl_vao = vao;
+    f_stats.vertex_arrays.issued++;
+}
+
+void CacheUseProgram(GLuint program)
+{
+    if (program == f_gl_program)
+    {
+        f_stats.programs.filtered++;
+        return;
+    }
+
+    glUseProgram(program);
+    f_gl_program = program;
+    f_stats.programs.issued++;
+}
+
+void CacheBindTexture(GLuint texture)
+{
+    if (texture == f_gl_texture)
+    {
+        f_stats.textures.filtered++;
+        return;
+    }
+
+    if (HasDirectStateAccess())
+        glBindTextureUnit(0, texture);
+    else
+        glBindTexture(GL_TEXTURE_2D, texture);
+    f_gl_texture = texture;
+    f_stats.textures.issued++;
+}
+
+void ForgetVertexArray(GLuint vao)
+{
+    if (vao == f_gl_vao)
+        f_gl_vao = GL_NONE;
+}
+
+void ForgetTexture(GLuint texture)
+{
+    if (texture == f_gl_texture)
+        f_gl_texture = GL_NONE;
+}
+
+void AdvanceStateCache()
+{
+    f_last_stats = f_stats;
+    f_stats = StateCacheStats();
+}
+
+StateCacheStats GetStateCacheStats()
+{
+    return f_last_stats;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <glad/glad.h>
+
+// Shadow copy of the GL bindings that change between draws. Setting a binding to what GL already has is skipped,
+// so Unbind/End functions don't touch GL at all: the next Bind/Begin replaces the binding only if it differs.
+// Only BindVertexArray, BeginShader & BeginTexture (and the code creating & destroying those objects) go through here,
+// anything binding them directly must restore what it found (like the ImGui renderer does).
+
+struct StateChangeCount
+{
+    int issued = 0;     // Calls that reached GL
+    int filtered = 0;   // Calls skipped since GL already had the binding
+};
+
+struct StateCacheStats
+{
+    StateChangeCount vertex_arrays;
+    StateChangeCount programs;
+    StateChangeCount textures;
+};
+
+void CacheBindVertexArray(GLuint vao);
+void CacheUseProgram(GLuint program);
+void CacheBindTexture(GLuint texture);     // Texture unit 0
+
+// GL drops the binding of a deleted vertex array or texture (programs in use outlive deletion, unbind those instead)
+void ForgetVertexArray(GLuint vao);
+void ForgetTexture(GLuint texture);
+
+// Call once per frame, starts counting the next frame's state changes
+void AdvanceStateCache();
+
+// Counts of the last complete frame
+StateCacheStats GetStateCacheStats();
@@ -1,4 +1,6 @@
 #include "Texture.h"
+#include "StateCache.h"
+#include "Window.h"
 #include <cassert>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -50,13 +52,43 @@ void SaveImage(const char* filename, const Image& image)
 	stbi_write_png(filename, image.width, image.height, image.channels, image.pixels.data(), 0);
 }
 
+// Same texture as below, but edited through its handle and with immutable storage so the driver can validate it once
+static void LoadTextureDirect(Texture* texture, const Image& image)
+{
+	GLuint handle = GL_NONE;
+	glCreateTextures(GL_TEXTURE_2D, 1, &handle);
+	assert(handle != GL_NONE);
+
+	glTextureParameteri(handle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(handle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(handle, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTextureParameteri(handle, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	// Flipped for the same reason as below. One mip level since we filter with GL_NEAREST.
+	stbi__vertical_flip((void*)image.pixels.data(), image.width, image.height, sizeof(Pixel));
+	glTextureStorage2D(handle, 1, GL_RGBA8, image.width, image.height);
+	glTextureSubImage2D(handle, 0, 0, 0, image.width, image.height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+
+	texture->width = image.width;
+	texture->height = image.height;
+	texture->channels = image.channels;
+	texture->handle = handle;
+}
+
 void LoadTexture(Texture* texture, const Image& image)
 {
+	assert(!image.pixels.empty() && image.width > 0 && image.height > 0 && image.channels == 4);
+	if (HasDirectStateAccess())
+	{
+		LoadTextureDirect(texture, image);
+		return;
+	}
+
     GLuint handle = GL_NONE;
     glGenTextures(1, &handle);
-	assert(handle != GL_NONE && !image.pixels.empty() && image.width > 0 && image.height > 0 && image.channels == 4);
+	assert(handle != GL_NONE);
 
-    glBindTexture(GL_TEXTURE_2D, handle);
+    CacheBindTexture(handle);
 
 	// What happens when our uv's exceed 0 & 1
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -73,7 +105,7 @@ void LoadTexture(Texture* texture, const Image& image)
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
 
 	// Unbind current texture so we don't accidentally overwrite textures
-	glBindTexture(GL_TEXTURE_2D, GL_NONE);
+	CacheBindTexture(GL_NONE);
 
 	// Make our internal texture representation reflect GPU texture
 	texture->width = image.width;
@@ -84,6 +116,7 @@ void LoadTexture(Texture* texture, const Image& image)
 
 void UnloadTexture(Texture* texture)
 {
+    ForgetTexture(texture->handle);
     glDeleteTextures(1, &texture->handle);
     texture->handle = GL_NONE;
     texture->width = texture->height = -1;
@@ -92,14 +125,13 @@ void UnloadTexture(Texture* texture)
 void BeginTexture(const Texture& texture)
 {
 	assert(f_texture == GL_NONE && texture.handle != GL_NONE);
-	glBindTexture(GL_TEXTURE_2D, texture.handle);
+	CacheBindTexture(texture.handle);
 	f_texture = texture.handle;
 }
 
 void EndTexture()
 {
-	assert(f_texture != GL_NONE);
-	glBindTexture(GL_TEXTURE_2D, GL_NONE);
+	assert(f_texture != GL_NONE);	// Stays bound in GL until another texture is needed
 	f_texture = GL_NONE;
 }
 
@@ -0,0 +1,93 @@
+#include "Uniforms.h"
+#include <cassert>
+#include <cstring>
+
+static_assert(sizeof(FrameUniforms) == 3 * 64 + 16, "FrameUniforms must match the std140 Frame block");
+static_assert(sizeof(ObjectUniforms) == 64 + 4 * 16, "ObjectUniforms must match the std140 Object block");
+
+// Room for 4k object blocks per frame (at the largest offset alignment) before the stream has to grow
+#define OBJECT_UNIFORM_STREAM_SIZE (4096 * 256)
+
+// Separate streams so growing the object ring mid-frame can't take the bound frame block with it
+static StreamBuffer f_frame_stream;
+static StreamBuffer f_object_stream;
+static GLint f_uniform_alignment = 0;
+
+static void CreateUniformBuffers()
+{
+    if (f_frame_stream.buffer != GL_NONE)
+        return;
+
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &f_uniform_alignment);
+    CreateStreamBuffer(&f_frame_stream, sizeof(FrameUniforms));
+    CreateStreamBuffer(&f_object_stream, OBJECT_UNIFORM_STREAM_SIZE);
+}
+
+void UpdateFrameUniforms(Matrix view, Matrix proj, float time)
+{
+    CreateUniformBuffers();
+
+    FrameUniforms frame;
+    frame.view = MatrixToFloatV(view);
+    frame.proj = MatrixToFloatV(proj);
+    frame.view_proj = MatrixToFloatV(view * proj);
+    frame.time = time;
+
+    StreamAllocation allocation;
+    AllocateStream(&f_frame_stream, sizeof(FrameUniforms), f_uniform_alignment, &allocation);
+    memcpy(allocation.data, &frame, sizeof(FrameUniforms));
+    FinishStreamAllocation(&f_frame_stream, &allocation);
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, allocation.buffer, allocation.offset, sizeof(FrameUniforms));
+}
+
+void AllocateObjectUniforms(int count, ObjectUniformBlocks* blocks)
+{
+    assert(count > 0);
+    CreateUniformBuffers();
+    blocks->stride = (int)((sizeof(ObjectUniforms) + f_uniform_alignment - 1) / f_uniform_alignment * f_uniform_alignment);
+    blocks->count = count;
+    AllocateStream(&f_object_stream, count * blocks->stride, f_uniform_alignment, &blocks->allocation);
+}
+
+ObjectUniforms* ObjectUniformsAt(ObjectUniformBlocks* blocks, int index)
+{
+    assert(index >= 0 && index < blocks->count && blocks->allocation.data != nullptr);
+    return (ObjectUniforms*)((uint8_t*)blocks->allocation.data + index * blocks->stride);
+}
+
+void FinishObjectUniforms(ObjectUniformBlocks* blocks)
+{
+    FinishStreamAllocation(&f_object_stream, &blocks->allocation);
+}
+
+void BindObjectUniforms(const ObjectUniformBlocks& blocks, int index)
+{
+    assert(index >= 0 && index < blocks.count);
+    int offset = blocks.allocation.offset + index * blocks.stride;
+    glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_UNIFORM_BINDING, blocks.allocation.buffer, offset, sizeof(ObjectUniforms));
+}
+
+void SetObjectUniforms(ObjectUniforms* object, const Mesh& mesh, Matrix world)
+{
+    const MeshQuantization& q = mesh.quantization;
+    object->world = MatrixToFloatV(world);
+    object->position_offset = { q.position_offset.x, q.position_offset.y, q.position_offset.z, 0.0f };
+    object->position_scale = { q.position_scale.x, q.position_scale.y, q.position_scale.z, 0.0f };
+    object->tcoord_offset_scale = { q.tcoord_offset.x, q.tcoord_offset.y, q.tcoord_scale.x, q.tcoord_scale.y };
+    object->octahedral_normals = mesh.quantized ? 1 : 0;
+}
+
+void AdvanceUniformBuffers()
+{
+    if (f_frame_stream.buffer == GL_NONE)
+        return;
+
+    AdvanceStreamBuffer(&f_frame_stream);
+    AdvanceStreamBuffer(&f_object_stream);
+}
+
+void UnloadUniformBuffers()
+{
+    DestroyStreamBuffer(&f_frame_stream);
+    DestroyStreamBuffer(&f_object_stream);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <glad/glad.h>
+#include "Buffer.h"
+#include "Mesh.h"
+
+// Uniform buffer binding points, every shader declares its blocks with layout (binding = ...)
+#define FRAME_UNIFORM_BINDING 0
+#define OBJECT_UNIFORM_BINDING 1
+
+// std140 "Frame" block: written once per frame and read by every program
+struct FrameUniforms
+{
+    float16 view;
+    float16 proj;
+    float16 view_proj;
+    float time;
+    float padding[3];
+};
+
+// std140 "Object" block: one per draw, packed into a single ring allocation and bound by offset
+struct ObjectUniforms
+{
+    float16 world;
+    Vector4 position_offset;        // xyz, mesh dequantization (see SendMeshQuantization)
+    Vector4 position_scale;         // xyz
+    Vector4 tcoord_offset_scale;    // xy offset, zw scale
+    int octahedral_normals;
+    int padding[3];
+};
+
+// This frame's object blocks, stride apart so each starts on GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+struct ObjectUniformBlocks
+{
+    StreamAllocation allocation;
+    int stride = 0;
+    int count = 0;
+};
+
+// Writes the frame block and binds it to FRAME_UNIFORM_BINDING. Call once per frame before drawing.
+void UpdateFrameUniforms(Matrix view, Matrix proj, float time);
+
+// Space for count object blocks. Fill them with ObjectUniformsAt, then finish before drawing.
+void AllocateObjectUniforms(int count, ObjectUniformBlocks* blocks);
+ObjectUniforms* ObjectUniformsAt(ObjectUniformBlocks* blocks, int index);
+void FinishObjectUniforms(ObjectUniformBlocks* blocks);
+
+// Points OBJECT_UNIFORM_BINDING at block index (no uniform upload, just a range bind)
+void BindObjectUniforms(const ObjectUniformBlocks& blocks, int index);
+
+// Object block for drawing mesh at world
+void SetObjectUniforms(ObjectUniforms* object, const Mesh& mesh, Matrix world);
+
+// Call once per frame after the frame's draws
+void AdvanceUniformBuffers();
+void UnloadUniformBuffers();
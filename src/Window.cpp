@@ -8,6 +8,7 @@
 
 #include "Window.h"
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <memory>
 
@@ -19,6 +20,8 @@ struct App
     float frame_time_begin = 0.0f;
     float frame_time_end = 0.0f;
     float frame_time_delta = 0.0f;
+    bool direct_state_access = false;
+    bool parallel_shader_compile = false;
 } g_app;
 
 void KeyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -101,6 +104,28 @@ void CreateWindow(int width, int height, const char* title)
     // Load OpenGL extensions
     assert(gladLoadGLLoader((GLADloadproc)glfwGetProcAddress));
 
+    // Drivers usually hand out their newest version when asked for 4.3, so direct state access is often available anyway
+    g_app.direct_state_access = GLAD_GL_VERSION_4_5 && glCreateBuffers != nullptr;
+    printf("OpenGL %s, %s\n", glGetString(GL_VERSION), g_app.direct_state_access ? "direct state access" : "bind-to-edit fallback");
+
+    // glad was generated without extensions, so look for KHR_parallel_shader_compile (or its ARB original) ourselves
+    GLint extension_count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+    for (GLint i = 0; i < extension_count; i++)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 || strcmp(extension, "GL_ARB_parallel_shader_compile") == 0)
+            g_app.parallel_shader_compile = true;
+    }
+
+    // Let the driver use as many compiler threads as it likes. Drivers with only the ARB extension only export the ARB entry point.
+    typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+    MaxShaderCompilerThreadsProc max_shader_compiler_threads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    if (max_shader_compiler_threads == nullptr)
+        max_shader_compiler_threads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+    if (g_app.parallel_shader_compile && max_shader_compiler_threads != nullptr)
+        max_shader_compiler_threads(0xFFFFFFFF);
+
     glfwSetKeyCallback(g_app.window, KeyboardCallback);
 #ifdef NDEBUG
 #else
@@ -142,6 +167,16 @@ bool WindowShouldClose()
     return glfwWindowShouldClose(g_app.window);
 }
 
+bool HasDirectStateAccess()
+{
+    return g_app.direct_state_access;
+}
+
+bool HasParallelShaderCompile()
+{
+    return g_app.parallel_shader_compile;
+}
+
 float FrameTime()
 {
     return g_app.frame_time_delta;
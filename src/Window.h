@@ -9,6 +9,12 @@ int WindowHeight();
 void SetWindowShouldClose(bool close);
 bool WindowShouldClose();
 
+// True if the context has GL 4.5 direct state access, which lets us edit objects without binding them first
+bool HasDirectStateAccess();
+
+// True if the driver compiles & links on its own threads and we can poll for completion (KHR_parallel_shader_compile)
+bool HasParallelShaderCompile();
+
 float FrameTime();
 float Time();
 void Loop();
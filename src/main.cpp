@@ -1,23 +1,48 @@
 #include "Window.h"
 #include "Shader.h"
+#include "Jobs.h"
 #include "Mesh.h"
+#include "MultiDraw.h"
+#include "RenderQueue.h"
+#include "StateCache.h"
 #include "Texture.h"
+#include "Uniforms.h"
 
 #include <imgui/imgui.h>
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
 #include <cstdlib>
 #include <cstdio>
 #include <ctime>
+#include <vector>
 
-enum ShaderType
+// Permutation bits of mesh.vert & mesh.frag, a draw's program is the variant of its features' mask
+enum MeshShaderFeature : uint32_t
 {
-    SHADER_SAMPLE_TEXTURE,
-    SHADER_POSITION_COLOR,
-    SHADER_TCOORD_COLOR,
-    SHADER_NORMAL_COLOR,
-    SHADER_TYPE_COUNT
+    MESH_SHADER_POSITION_COLOR = 0,         // No features: colored by position
+    MESH_SHADER_TEXTURED = 1 << 0,
+    MESH_SHADER_TCOORD_COLOR = 1 << 1,
+    MESH_SHADER_NORMAL_COLOR = 1 << 2,
+    MESH_SHADER_INSTANCED = 1 << 3
 };
 
+// The #define of each feature bit, in bit order
+#define MESH_SHADER_FEATURE_COUNT 4
+const char* MESH_SHADER_FEATURES[MESH_SHADER_FEATURE_COUNT] = { "TEXTURED", "TCOORD_COLOR", "NORMAL_COLOR", "INSTANCED" };
+
+// The variants the draw modes use, all compiled at startup
+const uint32_t MESH_SHADER_VARIANTS[] =
+{
+    MESH_SHADER_POSITION_COLOR,
+    MESH_SHADER_TEXTURED,
+    MESH_SHADER_TCOORD_COLOR,
+    MESH_SHADER_NORMAL_COLOR,
+    MESH_SHADER_TEXTURED | MESH_SHADER_INSTANCED,
+    MESH_SHADER_NORMAL_COLOR | MESH_SHADER_INSTANCED
+};
+#define MESH_SHADER_VARIANT_COUNT (int)(sizeof(MESH_SHADER_VARIANTS) / sizeof(MESH_SHADER_VARIANTS[0]))
+
 enum MeshType
 {
     // Platonic solids
@@ -36,6 +61,7 @@ enum MeshType
     // Obj files
     MESH_HEAD,
     MESH_CT4,
+    MESH_ASTEROID,
 
     MESH_TYPE_COUNT
 };
@@ -54,6 +80,9 @@ enum A4DrawType
     A4_CT4_TEXTURE_SHADER,
     A4_MANUAL_MESH,
     A4_CUSTOM_DRAW,
+    A4_MULTI_DRAW_INDIRECT,
+    A4_ASTEROID_FIELD,
+    A4_RENDER_QUEUE_GRID,
     A4_TYPE_COUNT
 };
 
@@ -72,6 +101,129 @@ void LoadTextures(Texture textures[TEXTURE_TYPE_COUNT])
     LoadTexture(&textures[TEXTURE_GRADIENT_COOL], cool);
 }
 
+// Per-frame count of draws skipped by frustum culling
+struct CullStats
+{
+    int tested = 0;
+    int culled = 0;
+};
+
+bool IsMeshVisible(const Mesh& mesh, Matrix world, const Frustum& frustum, CullStats* stats)
+{
+    bool visible = MeshInFrustum(mesh, world, frustum);
+    stats->tested++;
+    stats->culled += visible ? 0 : 1;
+    return visible;
+}
+
+// Grid of the float meshes drawn by A4_MULTI_DRAW_INDIRECT
+#define MULTI_DRAW_GRID_SIZE 32
+#define MULTI_DRAW_GRID_SPACING 3.0f
+
+// Ring of asteroids drawn by A4_ASTEROID_FIELD
+#define ASTEROID_COUNT 10000
+#define ASTEROID_RING_INNER 20.0f
+#define ASTEROID_RING_OUTER 40.0f
+
+float RandomRange(float min, float max)
+{
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+// Random placement within the ring (relative to the ring's centre & rotation)
+void GenerateAsteroids(std::vector<Matrix>* asteroids)
+{
+    asteroids->resize(ASTEROID_COUNT);
+    for (Matrix& asteroid : *asteroids)
+    {
+        float angle = RandomRange(0.0f, 2.0f * PI);
+        float radius = RandomRange(ASTEROID_RING_INNER, ASTEROID_RING_OUTER);
+        float scale = RandomRange(0.05f, 0.3f);
+        Vector3 axis = Vector3Normalize({ RandomRange(-1.0f, 1.0f), RandomRange(-1.0f, 1.0f), RandomRange(-1.0f, 1.0f) });
+        asteroid = MatrixScale(scale, scale, scale) * MatrixRotate(axis, RandomRange(0.0f, 2.0f * PI)) *
+            MatrixTranslate(cosf(angle) * radius, RandomRange(-1.5f, 1.5f), sinf(angle) * radius);
+    }
+}
+
+// How often (in seconds) shader files are checked for edits
+#define SHADER_RELOAD_INTERVAL 0.5f
+
+// Every program main draws with
+struct Shaders
+{
+    ShaderVariants mesh;            // Indexed by MeshShaderFeature mask
+    AsyncProgram multi_draw;
+    GLuint fallback = GL_NONE;      // Linked up front, see MeshProgram
+};
+
+// Returns true if any program became ready
+bool UpdateShaders(Shaders* shaders, bool check_files)
+{
+    bool ready = UpdateShaderVariants(&shaders->mesh, check_files);
+    ready |= UpdateAsyncProgram(&shaders->multi_draw, check_files);
+    return ready;
+}
+
+// Queued draws use the fallback until their variant links. Instanced draws feed matrices the fallback doesn't read,
+// so they get GL_NONE and are skipped until then (as is multi-draw, for its draw ids).
+GLuint MeshProgram(const Shaders& shaders, uint32_t features)
+{
+    GLuint fallback = features & MESH_SHADER_INSTANCED ? GL_NONE : shaders.fallback;
+    return ReadyProgram(GetShaderVariant(shaders.mesh, features), fallback);
+}
+
+// Drivers finish compiling a program for the state it's drawn with on its first draw, which would hitch the first frames.
+// Draw once with each program through the same paths the frame uses, placed behind the near plane so nothing is rasterized.
+// Runs before the frame clears, so whatever it does write never shows. Its draws share this frame's stream regions,
+// which move on once at the end of the frame like every other draw's.
+void WarmUpPrograms(const Shaders& shaders, const Mesh* meshes, const Texture* textures, MultiDrawBatch* multi_draw, RenderQueue* render_queue)
+{
+    const Mesh& mesh = meshes[MESH_SPHERE];
+    Matrix hidden = MatrixTranslate(0.0f, 0.0f, 10.0f);
+    UpdateFrameUniforms(MatrixIdentity(), MatrixIdentity(), 0.0f);
+
+    ClearRenderQueue(render_queue, 1.0f);
+    for (uint32_t features : MESH_SHADER_VARIANTS)
+    {
+        GLuint program = GetShaderVariant(shaders.mesh, features).program;
+        if (program == GL_NONE)
+            continue;
+
+        const Texture* texture = features & MESH_SHADER_TEXTURED ? &textures[TEXTURE_GRADIENT_COOL] : nullptr;
+        if (features & MESH_SHADER_INSTANCED)
+        {
+            BeginShader(program);
+            if (texture != nullptr)
+                BeginTexture(*texture);
+            SendMeshQuantization(mesh);
+            DrawMeshInstanced(mesh, &hidden, 1);
+            if (texture != nullptr)
+                EndTexture();
+            EndShader();
+            continue;
+        }
+
+        RenderCommand command;
+        command.program = program;
+        command.texture = texture;
+        command.mesh = &mesh;
+        command.world = hidden;
+        SubmitRenderCommand(render_queue, RENDER_LAYER_OPAQUE, command, 0.0f);
+    }
+    SortRenderQueue(render_queue);
+    ExecuteRenderQueue(render_queue);
+
+    if (shaders.multi_draw.program != GL_NONE)
+    {
+        ClearMultiDrawBatch(multi_draw);
+        AddMultiDraw(multi_draw, mesh, hidden);
+        BeginShader(shaders.multi_draw.program);
+            SendMeshQuantization(mesh);
+            SubmitMultiDrawBatch(multi_draw);
+        EndShader();
+    }
+}
+
 struct Camera
 {
     float pitch = 0.0f;
@@ -94,43 +246,66 @@ int main()
     LoadMeshPlane(&meshes[MESH_PLANE]);
     LoadMeshSphere(&meshes[MESH_SPHERE]);
     LoadMeshHemisphere(&meshes[MESH_HEMISPHERE]);
-    LoadMeshObj(&meshes[MESH_CT4], "./assets/meshes/ct4.obj");
+    meshes[MESH_CT4].quantized = true;
+    LoadMeshObjParallel(&meshes[MESH_CT4], "./assets/meshes/ct4.obj");
 
-    LoadMeshObj(&meshes[MESH_HEAD], "./assets/meshes/head.obj");
+    LoadMeshObjParallel(&meshes[MESH_HEAD], "./assets/meshes/head.obj");
+    LoadMeshObj(&meshes[MESH_ASTEROID], "./assets/meshes/asteroid.obj");
     
-    GLuint position_color_vert = CreateShader(GL_VERTEX_SHADER, "./assets/shaders/position_color.vert");
-    GLuint tcoord_color_vert = CreateShader(GL_VERTEX_SHADER, "./assets/shaders/tcoord_color.vert");
-    GLuint normal_color_vert = CreateShader(GL_VERTEX_SHADER, "./assets/shaders/normal_color.vert");
-    GLuint vertex_color_frag = CreateShader(GL_FRAGMENT_SHADER, "./assets/shaders/vertex_color.frag");
-    GLuint a4_texture_vert = CreateShader(GL_VERTEX_SHADER, "./assets/shaders/a4_texture.vert");
-    GLuint a4_texture_frag = CreateShader(GL_FRAGMENT_SHADER, "./assets/shaders/a4_texture.frag");
-
-    GLuint shaders[SHADER_TYPE_COUNT];
-    shaders[SHADER_SAMPLE_TEXTURE] = CreateProgram(a4_texture_vert, a4_texture_frag);
-    shaders[SHADER_POSITION_COLOR] = CreateProgram(position_color_vert, vertex_color_frag);
-    shaders[SHADER_TCOORD_COLOR] = CreateProgram(tcoord_color_vert, vertex_color_frag);
-    shaders[SHADER_NORMAL_COLOR] = CreateProgram(normal_color_vert, vertex_color_frag);
+    // Linked in the background (or loaded from the shader cache, see ShaderCache.h) and relinked when edited.
+    // The fallback is the one program we wait for, it stands in for queued draws until theirs are ready.
+    Shaders shaders;
+    shaders.fallback = LoadProgram("./assets/shaders/fallback.vert", "./assets/shaders/mesh.frag");
+    CreateShaderVariants(&shaders.mesh, "./assets/shaders/mesh.vert", "./assets/shaders/mesh.frag",
+        MESH_SHADER_FEATURES, MESH_SHADER_FEATURE_COUNT, MESH_SHADER_VARIANTS, MESH_SHADER_VARIANT_COUNT);
+    CreateAsyncProgram(&shaders.multi_draw, "./assets/shaders/multi_draw.vert", "./assets/shaders/mesh.frag");
+    float next_shader_check = 0.0f;
+
+    MultiDrawBatch multi_draw;
+    CreateMultiDrawBatch(&multi_draw);
+    RenderQueue render_queue;
+
+    // A4_RENDER_QUEUE_GRID draws the multi-draw grid one mesh at a time, each row recorded by its own job
+    RenderCommandBuffer grid_commands[MULTI_DRAW_GRID_SIZE];
+    CullStats grid_cull_stats[MULTI_DRAW_GRID_SIZE];
+
+    srand(1);
+    std::vector<Matrix> asteroids;
+    std::vector<Matrix> visible_asteroids[2];
+    GenerateAsteroids(&asteroids);
 
     Texture textures[TEXTURE_TYPE_COUNT];
     LoadTextures(textures);
 
+    WarmUpPrograms(shaders, meshes, textures, &multi_draw, &render_queue);
+
     Camera camera;
     camera.position = { 0.0f, 0.0f, 5.0f };
 
-    int shader_index = SHADER_SAMPLE_TEXTURE;
+    int shader_index = 1;    // Into MESH_SHADER_VARIANTS
     int mesh_index = MESH_PLANE;
     int texture_index = TEXTURE_GRADIENT_COOL;
     int draw_index = A4_PAR_SHAPES_NORMAL_SHADER;
+
+    RayHit pick;
+    double pick_ms = 0.0;
     while (!WindowShouldClose())
     {
         BeginFrame();
         float dt = FrameTime();
 
+        // Programs that finished linking (or were edited) get their warm-up draw before the frame uses them
+        bool check_shader_files = Time() >= next_shader_check;
+        if (check_shader_files)
+            next_shader_check = Time() + SHADER_RELOAD_INTERVAL;
+        if (UpdateShaders(&shaders, check_shader_files))
+            WarmUpPrograms(shaders, meshes, textures, &multi_draw, &render_queue);
+
         if (IsKeyPressed(KEY_ESCAPE))
             SetWindowShouldClose(true);
 
         if (IsKeyPressed(KEY_GRAVE_ACCENT))
-            ++shader_index %= SHADER_TYPE_COUNT;
+            ++shader_index %= MESH_SHADER_VARIANT_COUNT;
 
         if (IsKeyPressed(KEY_TAB))
             mesh_index = MESH_PLANE + ((mesh_index + 1) % MESH_TYPE_COUNT);
@@ -183,18 +358,30 @@ int main()
 
         // view-matrix is the inverse of the camera matrix
         // camera-matrix is the translation & rotation about y & x of the camera
-        Matrix proj = MatrixPerspective(75.0f * DEG2RAD, WindowWidth() / (float)WindowHeight(), 0.01f, 100.0f);
+        float fov_y = 75.0f * DEG2RAD;
+        float far_plane = 100.0f;
+        Matrix proj = MatrixPerspective(fov_y, WindowWidth() / (float)WindowHeight(), 0.01f, far_plane);
         Matrix view = MatrixInvert(camera_rotation * MatrixTranslate(camera.position.x, camera.position.y, camera.position.z));
         Matrix world = MatrixIdentity();
-        Matrix mvp = world * view * proj;
+        Frustum frustum = FrustumFromMatrix(view * proj);
+        UpdateFrameUniforms(view, proj, tt);
+        CullStats cull_stats;
+
+        // Distance from the camera to the object's origin decides how much detail we can get away with
+        float world_distance = Vector3Distance(camera.position, { world.m12, world.m13, world.m14 });
 
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // Single-mesh draws are queued & sorted, the batched modes submit their own draws
+        ClearRenderQueue(&render_queue, far_plane);
+        RenderCommand command;
+
         // Example "mix-and-match" draw calls to understand Smiley's code
-        //BeginShader(shaders[shader_index]);
+        //static constexpr UniformName u_mvp = "u_mvp";
+        //BeginShader(MeshProgram(shaders, MESH_SHADER_VARIANTS[shader_index]));
         //BeginTexture(textures[texture_index]);
-        //    SendMat4(mvp, "u_mvp");
+        //    SendMat4(mvp, u_mvp);
         //    DrawMesh(meshes[mesh_index]);
         //EndTexture();
         //EndShader();
@@ -203,69 +390,235 @@ int main()
         switch (draw_index)
         {
         case A4_PAR_SHAPES_NORMAL_SHADER:
-            BeginShader(shaders[SHADER_NORMAL_COLOR]);
-                SendMat4(mvp, "u_mvp");
-                DrawMesh(meshes[MESH_SPHERE]);
-            EndShader();
+            if (IsMeshVisible(meshes[MESH_SPHERE], world, frustum, &cull_stats))
+            {
+                command.program = MeshProgram(shaders, MESH_SHADER_NORMAL_COLOR);
+                command.mesh = &meshes[MESH_SPHERE];
+                command.world = world;
+                SubmitRenderCommand(&render_queue, RENDER_LAYER_OPAQUE, command, world_distance);
+            }
             break;
 
         case A4_OBJ_FILE_TCOORDS_SHADER:
-            BeginShader(shaders[SHADER_TCOORD_COLOR]);
-                SendMat4(mvp, "u_mvp");
-                DrawMesh(meshes[MESH_HEAD]);
-            EndShader();
+            if (IsMeshVisible(meshes[MESH_HEAD], world, frustum, &cull_stats))
+            {
+                command.program = MeshProgram(shaders, MESH_SHADER_TCOORD_COLOR);
+                command.mesh = &meshes[MESH_HEAD];
+                command.lod = SelectMeshLod(meshes[MESH_HEAD], world_distance, fov_y, WindowHeight());
+                command.world = world;
+                SubmitRenderCommand(&render_queue, RENDER_LAYER_OPAQUE, command, world_distance);
+            }
             break;
 
         case A4_CT4_TEXTURE_SHADER:
-            BeginShader(shaders[SHADER_SAMPLE_TEXTURE]);
-            BeginTexture(textures[texture_index]);
-                SendMat4(mvp, "u_mvp");
-                DrawMesh(meshes[MESH_CT4]);
-            EndTexture();
-            EndShader();
+            if (IsMeshVisible(meshes[MESH_CT4], world, frustum, &cull_stats))
+            {
+                command.program = MeshProgram(shaders, MESH_SHADER_TEXTURED);
+                command.texture = &textures[texture_index];
+                command.mesh = &meshes[MESH_CT4];
+                command.lod = SelectMeshLod(meshes[MESH_CT4], world_distance, fov_y, WindowHeight());
+                command.world = world;
+                SubmitRenderCommand(&render_queue, RENDER_LAYER_OPAQUE, command, world_distance);
+            }
             break;
 
         case A4_MANUAL_MESH:
-            BeginShader(shaders[SHADER_POSITION_COLOR]);
-                SendMat4(mvp, "u_mvp");
-                DrawMesh(meshes[MESH_PLANE]);
-            EndShader();
+            if (IsMeshVisible(meshes[MESH_PLANE], world, frustum, &cull_stats))
+            {
+                command.program = MeshProgram(shaders, MESH_SHADER_POSITION_COLOR);
+                command.mesh = &meshes[MESH_PLANE];
+                command.world = world;
+                SubmitRenderCommand(&render_queue, RENDER_LAYER_OPAQUE, command, world_distance);
+            }
             break;
 
         case A4_CUSTOM_DRAW:
+        {
             Matrix world_custom = MatrixRotateY(tt); 
-            Matrix mvp_custom = world_custom * view * proj;
 
-            BeginShader(shaders[SHADER_SAMPLE_TEXTURE]);
-            BeginTexture(textures[texture_index]);
-                SendMat4(mvp_custom, "u_mvp");
-                DrawMesh(meshes[MESH_HEMISPHERE]);
-            EndTexture();
-            EndShader();
+            if (IsMeshVisible(meshes[MESH_HEMISPHERE], world_custom, frustum, &cull_stats))
+            {
+                command.program = MeshProgram(shaders, MESH_SHADER_TEXTURED);
+                command.texture = &textures[texture_index];
+                command.mesh = &meshes[MESH_HEMISPHERE];
+                command.world = world_custom;
+                SubmitRenderCommand(&render_queue, RENDER_LAYER_OPAQUE, command, world_distance);
+            }
+        }
+            break;
+
+        case A4_MULTI_DRAW_INDIRECT:
+        {
+            // Culling & lod selection stay on the CPU, the draws themselves cost one command each
+            const int grid_meshes[] = { MESH_SPHERE, MESH_HEMISPHERE, MESH_HEAD, MESH_PLANE };
+            ClearMultiDrawBatch(&multi_draw);
+            for (int z = 0; z < MULTI_DRAW_GRID_SIZE; z++)
+            {
+                for (int x = 0; x < MULTI_DRAW_GRID_SIZE; x++)
+                {
+                    const Mesh& mesh = meshes[grid_meshes[(x + z) % 4]];
+                    Vector3 position = { (x - MULTI_DRAW_GRID_SIZE / 2) * MULTI_DRAW_GRID_SPACING, 0.0f, -z * MULTI_DRAW_GRID_SPACING };
+                    Matrix world_object = MatrixRotateY(tt + x + z) * MatrixTranslate(position.x, position.y, position.z);
+                    if (!IsMeshVisible(mesh, world_object, frustum, &cull_stats))
+                        continue;
+
+                    int lod = mesh.lods.empty() ? 0 : SelectMeshLod(mesh, Vector3Distance(camera.position, position), fov_y, WindowHeight());
+                    AddMultiDraw(&multi_draw, mesh, world_object, lod);
+                }
+            }
+
+            if (shaders.multi_draw.program != GL_NONE)
+            {
+                BeginShader(shaders.multi_draw.program);
+                    SendMeshQuantization(meshes[MESH_SPHERE]);
+                    SubmitMultiDrawBatch(&multi_draw);
+                EndShader();
+            }
+        }
             break;
+
+        case A4_ASTEROID_FIELD:
+        {
+            // Culled per asteroid, then every other asteroid goes to each of the instanced shaders
+            const Mesh& asteroid = meshes[MESH_ASTEROID];
+            Matrix orbit = MatrixRotateY(tt * 0.05f) * MatrixTranslate(0.0f, -5.0f, -30.0f);
+            visible_asteroids[0].clear();
+            visible_asteroids[1].clear();
+            for (int i = 0; i < ASTEROID_COUNT; i++)
+            {
+                Matrix world_asteroid = asteroids[i] * orbit;
+                if (IsMeshVisible(asteroid, world_asteroid, frustum, &cull_stats))
+                    visible_asteroids[i % 2].push_back(world_asteroid);
+            }
+
+            GLuint textured_instanced = MeshProgram(shaders, MESH_SHADER_TEXTURED | MESH_SHADER_INSTANCED);
+            if (textured_instanced != GL_NONE)
+            {
+                BeginShader(textured_instanced);
+                BeginTexture(textures[texture_index]);
+                    SendMeshQuantization(asteroid);
+                    DrawMeshInstanced(asteroid, visible_asteroids[0].data(), (int)visible_asteroids[0].size());
+                EndTexture();
+                EndShader();
+            }
+
+            GLuint normal_color_instanced = MeshProgram(shaders, MESH_SHADER_NORMAL_COLOR | MESH_SHADER_INSTANCED);
+            if (normal_color_instanced != GL_NONE)
+            {
+                BeginShader(normal_color_instanced);
+                    SendMeshQuantization(asteroid);
+                    DrawMeshInstanced(asteroid, visible_asteroids[1].data(), (int)visible_asteroids[1].size());
+                EndShader();
+            }
         }
+            break;
+
+        case A4_RENDER_QUEUE_GRID:
+        {
+            // Jobs only cull, pick lods & build matrices and keys. GL calls stay on this thread, so read the window size here too.
+            const int grid_meshes[] = { MESH_SPHERE, MESH_HEMISPHERE, MESH_HEAD, MESH_PLANE };
+            float viewport_height = (float)WindowHeight();
+            ParallelFor(MULTI_DRAW_GRID_SIZE, [&](int z)
+            {
+                ClearRenderCommandBuffer(&grid_commands[z], far_plane);
+                grid_cull_stats[z] = CullStats();
+                for (int x = 0; x < MULTI_DRAW_GRID_SIZE; x++)
+                {
+                    const Mesh& mesh = meshes[grid_meshes[(x + z) % 4]];
+                    Vector3 position = { (x - MULTI_DRAW_GRID_SIZE / 2) * MULTI_DRAW_GRID_SPACING, 0.0f, -z * MULTI_DRAW_GRID_SPACING };
+                    Matrix world_object = MatrixRotateY(tt + x + z) * MatrixTranslate(position.x, position.y, position.z);
+                    if (!IsMeshVisible(mesh, world_object, frustum, &grid_cull_stats[z]))
+                        continue;
+
+                    // Checkerboard of textured & normal-coloured draws for the queue to sort into runs
+                    float distance = Vector3Distance(camera.position, position);
+                    RenderCommand grid_command;
+                    grid_command.program = MeshProgram(shaders, (x + z) % 2 ? MESH_SHADER_NORMAL_COLOR : MESH_SHADER_TEXTURED);
+                    grid_command.texture = (x + z) % 2 ? nullptr : &textures[(x / 2 + z) % TEXTURE_TYPE_COUNT];
+                    grid_command.mesh = &mesh;
+                    grid_command.lod = mesh.lods.empty() ? 0 : SelectMeshLod(mesh, distance, fov_y, viewport_height);
+                    grid_command.world = world_object;
+                    RecordRenderCommand(&grid_commands[z], RENDER_LAYER_OPAQUE, grid_command, distance);
+                }
+            });
+
+            MergeRenderCommandBuffers(&render_queue, grid_commands, MULTI_DRAW_GRID_SIZE);
+            for (const CullStats& row_stats : grid_cull_stats)
+            {
+                cull_stats.tested += row_stats.tested;
+                cull_stats.culled += row_stats.culled;
+            }
+        }
+            break;
+        }
+
+        SortRenderQueue(&render_queue);
+        ExecuteRenderQueue(&render_queue);
 
         BeginGui();
         //ImGui::ShowDemoWindow(nullptr);
+
+        // Click to pick a triangle of the obj meshes. Their world matrix is the identity so world-space rays are object-space rays.
+        int pick_mesh = draw_index == A4_CT4_TEXTURE_SHADER ? MESH_CT4 : (draw_index == A4_OBJ_FILE_TCOORDS_SHADER ? MESH_HEAD : -1);
+        if (pick_mesh >= 0 && ImGui::IsMouseClicked(ImGuiMouseButton_Left) && !ImGui::GetIO().WantCaptureMouse)
+        {
+            ImVec2 mouse = ImGui::GetIO().MousePos;
+            Vector3 ndc = { 2.0f * mouse.x / WindowWidth() - 1.0f, 1.0f - 2.0f * mouse.y / WindowHeight(), 1.0f };
+            Vector3 direction = Vector3Normalize(Vector3Unproject(ndc, proj, view) - camera.position);
+
+            auto pick_start = std::chrono::high_resolution_clock::now();
+            RaycastMesh(meshes[pick_mesh], camera.position, direction, &pick);
+            pick_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - pick_start).count();
+        }
+
+        ImGui::Begin("Stats");
+        ImGui::Text("Draws: %i of %i (%i culled)", cull_stats.tested - cull_stats.culled, cull_stats.tested, cull_stats.culled);
+        if (draw_index == A4_MULTI_DRAW_INDIRECT)
+            ImGui::Text("Multi-draw: %i commands, %i + %i calls", (int)multi_draw.objects.size(),
+                multi_draw.commands16.empty() ? 0 : 1, multi_draw.commands32.empty() ? 0 : 1);
+        ImGui::Text("Render queue: %i commands, %i program & %i texture switches", render_queue.stats.commands,
+            render_queue.stats.program_switches, render_queue.stats.texture_switches);
+        StateCacheStats state_stats = GetStateCacheStats();
+        ImGui::Text("State changes (issued/filtered): vertex arrays %i/%i, programs %i/%i, textures %i/%i",
+            state_stats.vertex_arrays.issued, state_stats.vertex_arrays.filtered, state_stats.programs.issued, state_stats.programs.filtered,
+            state_stats.textures.issued, state_stats.textures.filtered);
+        for (int quantized = 0; quantized < 2; quantized++)
+        {
+            BufferPoolStats vertex_stats, index_stats;
+            GetMeshArenaStats(quantized != 0, &vertex_stats, &index_stats);
+            ImGui::Text("%s meshes: vertices %.1f of %.1f MB, indices %.1f of %.1f MB (%.0f%% fragmented)", quantized ? "Quantized" : "Float",
+                vertex_stats.used / (1024.0f * 1024.0f), vertex_stats.capacity / (1024.0f * 1024.0f),
+                index_stats.used / (1024.0f * 1024.0f), index_stats.capacity / (1024.0f * 1024.0f),
+                100.0f * std::max(vertex_stats.fragmentation, index_stats.fragmentation));
+        }
+        if (pick.triangle >= 0)
+            ImGui::Text("Picked triangle %i at %.3f (u %.2f, v %.2f) in %.4f ms", pick.triangle, pick.distance, pick.u, pick.v, pick_ms);
+        else
+            ImGui::Text("Click ct4 or the head to pick a triangle");
+        ImGui::End();
         EndGui();
 
+        UpdateMeshBuffers();
+        AdvanceMultiDrawBatch(&multi_draw);
+        AdvanceStateCache();
+        AdvanceUniformBuffers();
         Loop();
         EndFrame();
     }
 
-    DestroyShader(&position_color_vert);
-    DestroyShader(&tcoord_color_vert);
-    DestroyShader(&normal_color_vert);
-    DestroyShader(&vertex_color_frag);
+    DestroyMultiDrawBatch(&multi_draw);
 
     for (int i = 0; i < TEXTURE_TYPE_COUNT; i++)
         UnloadTexture(&textures[i]);
 
-    for (int i = 0; i < SHADER_TYPE_COUNT; i++)
-        DestroyProgram(&shaders[i]);
+    DestroyShaderVariants(&shaders.mesh);
+    DestroyAsyncProgram(&shaders.multi_draw);
+    DestroyProgram(&shaders.fallback);
 
     for (int i = 0; i < MESH_TYPE_COUNT; i++)
         UnloadMesh(&meshes[i]);
+    UnloadMeshBuffers();
+    UnloadUniformBuffers();
 
     DestroyWindow();
     return 0;